@@ -3,6 +3,7 @@
 
 #include <fstream>
 #include <iomanip>
+#include <set>
 
 #include <boost/program_options/cmdline.hpp>
 #include <boost/program_options/options_description.hpp>
@@ -20,36 +21,138 @@
 #include <boost/filesystem.hpp>
 
 #include "parsedb.h"
+#include "svdb.h"
+#include "sweep.h"
+#include "lazydb.h"
 #include "query.h"
-#include "bed.h"
-#include "gtf.h"
-#include "gff3.h"
+#include "track.h"
 
 namespace sansa
 {
 
   struct AnnotateConfig {
     typedef std::map<std::string, int32_t> TChrMap;
-    bool hasCT;
     bool matchSvType;
     bool bestMatch;
     bool reportNoMatch;
     bool containedGenes;
-    int32_t gtfFileFormat;   // 0 = gtf, 1 = bed, 2 = gff3
+    bool featureSummary;
+    bool tabix;
+    bool streaming;
+    bool lazy;
+    bool uncompressed;
     int32_t bpwindow;
     int32_t maxDistance;
+    int32_t threads;
+    uint32_t batchsize;
+    uint32_t memoSize;
     float sizediff;
-    std::string idname;
-    std::string feature;
+    std::vector<DatabaseConfig> dbs;   // One per -d file
+    std::vector<FeatureConfig> tracks;   // One per -g file
     TChrMap nchr;
-    boost::filesystem::path gtfFile;
-    boost::filesystem::path annofile;
-    boost::filesystem::path db;
+    htsThreadPool tpool;
     boost::filesystem::path matchfile;
+    boost::filesystem::path outvcf;
     boost::filesystem::path infile;
   };
 
 
+  template<typename TConfig>
+  inline void
+  _loadChrNames(TConfig& c, bcf_hdr_t const* hdr, int32_t& maxRID) {
+    uint32_t numseq = chrMapSize(c.nchr);
+    int32_t nseq=0;
+    const char** seqnames = bcf_hdr_seqnames(hdr, &nseq);
+    for(int32_t i = 0; i<nseq;++i) {
+      std::string chrName(bcf_hdr_id2name(hdr, i));
+      if (c.nchr.find(chrName) == c.nchr.end()) c.nchr[chrName] = numseq++;
+    }
+    if (seqnames!=NULL) free(seqnames);
+
+    // Fix chrX vs X naming inconsistencies
+    maxRID = fixChrNames(c);
+
+    // Debug
+    //typedef typename TConfig::TChrMap TChrMap;
+    //for(typename TChrMap::const_iterator itcm = c.nchr.begin(); itcm != c.nchr.end(); ++itcm) std::cerr << itcm->first << ',' << itcm->second << std::endl;
+  }
+
+  template<typename TConfig>
+  inline bool
+  _loadChrNames(TConfig& c, boost::filesystem::path const& vcffile, int32_t& maxRID) {
+    htsFile* ifile = bcf_open(vcffile.string().c_str(), "r");
+    if (ifile == NULL) {
+      std::cerr << "Fail to load " << vcffile.string() << std::endl;
+      return false;
+    }
+    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    _loadChrNames(c, hdr, maxRID);
+    bcf_hdr_destroy(hdr);
+    bcf_close(ifile);
+    return true;
+  }
+
+  // Binary databases carry their own sequence dictionary, shared chromosome names have to map to the same index
+  template<typename TChrMap>
+  inline bool
+  _mergeChrNames(TChrMap& nchr, TChrMap const& dbchr, boost::filesystem::path const& db) {
+    std::set<int32_t> used;
+    for(typename TChrMap::const_iterator itcm = nchr.begin(); itcm != nchr.end(); ++itcm) used.insert(itcm->second);
+    for(typename TChrMap::const_iterator itdb = dbchr.begin(); itdb != dbchr.end(); ++itdb) {
+      typename TChrMap::const_iterator itcm = nchr.find(itdb->first);
+      if (((itcm != nchr.end()) && (itcm->second != itdb->second)) || ((itcm == nchr.end()) && (used.find(itdb->second) != used.end()))) {
+	std::cerr << "Sequence dictionary of " << db.string() << " conflicts with a previous binary database, please rebuild both using sansa dbindex on the same reference." << std::endl;
+	return false;
+      }
+    }
+    nchr.insert(dbchr.begin(), dbchr.end());
+    return true;
+  }
+
+  // Annotation output of the k-th database if -a was given once, e.g. anno.bcf, anno2.bcf, ...
+  inline boost::filesystem::path
+  _suffixedPath(boost::filesystem::path const& p, uint32_t const k) {
+    if (!k) return p;
+    return p.parent_path() / (p.stem().string() + _columnSuffix(k) + p.extension().string());
+  }
+
+  // Chromosomes of all query SV breakpoints
+  template<typename TConfig>
+  inline bool
+  _queryContigs(TConfig const& c, std::vector<bool>& queryChr) {
+    htsFile* ifile = bcf_open(c.infile.string().c_str(), "r");
+    if (ifile == NULL) {
+      std::cerr << "Fail to load " << c.infile.string() << std::endl;
+      return false;
+    }
+    _attachThreadPool(ifile, c.tpool);
+    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
+    SVRecordFields f;
+    bcf1_t* rec = bcf_init();
+    std::vector<int32_t> ridMap(hdr->n[BCF_DT_CTG], 0);
+    for(int32_t rid = 0; rid < hdr->n[BCF_DT_CTG]; ++rid) ridMap[rid] = _chrIndex(c.nchr, std::string(bcf_hdr_id2name(hdr, rid)));
+    queryChr.assign(chrMapSize(c.nchr), false);
+    uint32_t nchr = 0;
+    while (bcf_read(ifile, hdr, rec) == 0) {
+      if (!_decodeSVRecord(dec, rec, f)) continue;
+      int32_t bpChr[2] = {ridMap[rec->rid], _chrIndex(c.nchr, f.chr2Name)};
+      for(uint32_t k = 0; k < 2; ++k) {
+	if ((bpChr[k] < (int32_t) queryChr.size()) && (!queryChr[bpChr[k]])) {
+	  queryChr[bpChr[k]] = true;
+	  ++nchr;
+	}
+      }
+    }
+    bcf_destroy(rec);
+    bcf_hdr_destroy(hdr);
+    bcf_close(ifile);
+
+    // No query SVs, load all features
+    if (!nchr) queryChr.clear();
+    return true;
+  }
+
   template<typename TConfig>
   inline int32_t
   runAnnotate(TConfig& c) {
@@ -58,66 +161,123 @@ namespace sansa
     ProfilerStart("sansa.prof");
 #endif
 
-    // Unify sequence dictionaries
-    int32_t maxRID;
-    uint32_t numseq = 0;
-    for(uint32_t k = 0; k < 2; ++k) {
-      htsFile* ifile = NULL;
-      if (k == 0) ifile = bcf_open(c.db.string().c_str(), "r");
-      else ifile = bcf_open(c.infile.string().c_str(), "r");
-      bcf_hdr_t* hdr = bcf_hdr_read(ifile);
-      int32_t nseq=0;
-      const char** seqnames = bcf_hdr_seqnames(hdr, &nseq);
-      for(int32_t i = 0; i<nseq;++i) {
-	std::string chrName(bcf_hdr_id2name(hdr, i));
-	if (c.nchr.find(chrName) == c.nchr.end()) c.nchr[chrName] = numseq++;
-      }
-      if (seqnames!=NULL) free(seqnames);
-      bcf_hdr_destroy(hdr);
-      bcf_close(ifile);
+    // Shared htslib thread pool
+    ThreadPoolGuard poolGuard(c.tpool, c.threads);
+    boost::posix_time::ptime stage = boost::posix_time::microsec_clock::local_time();
 
-      // Fix chrX vs X naming inconsistencies
-      maxRID = fixChrNames(c);
+    // Structural variants, one per database
+    uint32_t ndb = c.dbs.size();
+    std::vector<SVDatabase> svs(c.streaming ? 0 : ndb);
+    std::vector<SVSweep> sweep(c.streaming ? ndb : 0);
 
-      // Debug
-      //typedef typename TConfig::TChrMap TChrMap;
-      //for(typename TChrMap::const_iterator itcm = c.nchr.begin(); itcm != c.nchr.end(); ++itcm) std::cerr << itcm->first << ',' << itcm->second << std::endl;
+    // Unify sequence dictionaries, binary databases first because they carry their own dictionary
+    int32_t maxRID = 0;
+    for(uint32_t k = 0; k < ndb; ++k) {
+      if (c.dbs[k].dbFormat != 1) continue;
+      typename TConfig::TChrMap dbchr;
+      if (!loadSVDatabase(c, c.dbs[k], svs[k], dbchr)) {
+	std::cerr << "Sansa couldn't load binary database " << c.dbs[k].db.string() << "!" << std::endl;
+	return 1;
+      }
+      if (!_mergeChrNames(c.nchr, dbchr, c.dbs[k].db)) return 1;
+    }
+    for(uint32_t k = 0; k < ndb; ++k) {
+      if (c.dbs[k].dbFormat == 0) {
+	if (!_loadChrNames(c, c.dbs[k].db, maxRID)) return 1;
+      }
     }
 
-    // Structural variants
-    typedef std::vector<SV> TSV;
-    TSV svs;
-    
-    // Parse DB
-    if (!parseDB(c, svs)) {
-      std::cerr << "Sansa couldn't parse database!" << std::endl;
+    // Query input is opened once, it may be a pipe (-)
+    htsFile* ifile = bcf_open(c.infile.string().c_str(), "r");
+    if (ifile == NULL) {
+      std::cerr << "Fail to load " << c.infile.string() << std::endl;
       return 1;
     }
+    _attachThreadPool(ifile, c.tpool);
+    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    if (hdr == NULL) {
+      std::cerr << "Fail to read VCF/BCF header of " << c.infile.string() << std::endl;
+      return 1;
+    }
+    _loadChrNames(c, hdr, maxRID);
 
-    // Optionally parse GFF/GTF/BED file
-    typedef std::vector<IntervalLabel> TChromosomeRegions;
-    typedef std::vector<TChromosomeRegions> TGenomicRegions;
-    TGenomicRegions gRegions;
-    gRegions.resize(maxRID, TChromosomeRegions());
-    typedef std::vector<std::string> TGeneIds;
-    TGeneIds geneIds;
-    if (c.gtfFileFormat != -1) {
-      int32_t tf = 0;
-      if (c.gtfFileFormat == 0) tf = parseGTF(c, gRegions, geneIds);
-      else if (c.gtfFileFormat == 1) tf = parseBED(c, gRegions, geneIds);
-      else if (c.gtfFileFormat == 2) tf = parseGFF3(c, gRegions, geneIds);
-      if (tf == 0) {
-	std::cerr << "Error parsing GTF/GFF3/BED file!" << std::endl;
+    // Parse VCF/BCF databases, one thread per database
+    std::vector<uint8_t> dbLoaded(ndb, 1);
+#ifdef OPENMP
+    omp_set_num_threads(c.threads);
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for(int32_t k = 0; k < (int32_t) ndb; ++k) {
+      if (c.streaming) dbLoaded[k] = openSweep(c, c.dbs[k], sweep[k]);
+      else if (c.dbs[k].dbFormat == 0) {
+	bool hasCT = false;
+	if (c.lazy) dbLoaded[k] = parseDBRegions(c, c.dbs[k], svs[k].svs, svs[k].fields);
+	else dbLoaded[k] = parseDB(c, c.dbs[k], svs[k].svs, svs[k].fields, hasCT);
+	if (dbLoaded[k]) svs[k].attach(c);
+      }
+    }
+    for(uint32_t k = 0; k < ndb; ++k) {
+      if (!dbLoaded[k]) {
+	std::cerr << "Sansa couldn't parse database " << c.dbs[k].db.string() << "!" << std::endl;
 	return 1;
       }
-      for(int32_t refIndex = 0; refIndex < maxRID; ++refIndex) std::sort(gRegions[refIndex].begin(), gRegions[refIndex].end());
+    }
+    _stageTime("Database loading", stage);
+
+    // Optionally parse GFF/GTF/BED files
+    stage = boost::posix_time::microsec_clock::local_time();
+    std::vector<FeatureTrack> tracks(c.tracks.size());
+    bool indexedTrack = false;
+    for(uint32_t t = 0; t < c.tracks.size(); ++t) {
+      tracks[t].fc = c.tracks[t];
+      tracks[t].fc.nchr = c.nchr;
+      if ((c.tracks[t].gtfFileFormat != 3) && (is_tabixed(c.tracks[t].gtfFile))) indexedTrack = true;
+    }
+
+    // Indexed feature files are only read on query chromosomes, the query is scanned once for all tracks
+    // A piped query cannot be read twice, all chromosomes are loaded then
+    if ((indexedTrack) && (c.infile.string() != "-")) {
+      std::vector<bool> queryChr;
+      if (!_queryContigs(c, queryChr)) return 1;
+      for(uint32_t t = 0; t < tracks.size(); ++t) {
+	if (tracks[t].fc.gtfFileFormat != 3) tracks[t].fc.queryChr = queryChr;
+      }
     }
 
+    // Parse and index feature tracks, one thread per feature file
+    std::vector<std::vector<uint32_t> > groups;
+    _featureTrackGroups(tracks, groups);
+    std::vector<uint8_t> groupLoaded(groups.size(), 0);
+#ifdef OPENMP
+    omp_set_num_threads(c.threads);
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for(int32_t g = 0; g < (int32_t) groups.size(); ++g) groupLoaded[g] = loadFeatureTracks(tracks, groups[g], maxRID, c.featureSummary);
+    for(uint32_t g = 0; g < groups.size(); ++g) {
+      if (!groupLoaded[g]) return 1;
+    }
+    _stageTime("Feature loading and indexing", stage);
+
     // Query SV
-    query(c, svs, gRegions, geneIds);
+    stage = boost::posix_time::microsec_clock::local_time();
+    boost::posix_time::ptime now;
+    bool success = true;
+    if (c.streaming) {
+      success = query(c, ifile, hdr, sweep, tracks);
+      now = boost::posix_time::second_clock::local_time();
+      for(uint32_t k = 0; k < ndb; ++k) std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Peak database window of " << c.dbs[k].db.string() << ": " << sweep[k].peakWindow << " intra-chromosomal SVs." << std::endl;
+    } else success = query(c, ifile, hdr, svs, tracks);
+    bcf_hdr_destroy(hdr);
+    bcf_close(ifile);
+    if (!success) {
+      std::cerr << "Sansa couldn't annotate query SVs!" << std::endl;
+      return 1;
+    }
+    _stageTime("SV query", stage);
+    _destroyThreadPool(c.tpool);
     
     // End
-    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Done." << std::endl;
     return 0;
   }
@@ -126,40 +286,55 @@ namespace sansa
   
   int annotate(int argc, char** argv) {
     AnnotateConfig c;
-    c.hasCT = false;
     std::string strategy = "best";
+    std::vector<std::string> dbFields;
+    std::vector<boost::filesystem::path> dbFiles;
+    std::vector<boost::filesystem::path> annoFiles;
+    std::vector<boost::filesystem::path> gtfFiles;
+    std::vector<std::string> idnames;
+    std::vector<std::string> features;
     
     // Parameter
     boost::program_options::options_description generic("Generic options");
     generic.add_options()
       ("help,?", "show help message")
-      ("anno,a", boost::program_options::value<boost::filesystem::path>(&c.annofile)->default_value("anno.bcf"), "output annotation VCF/BCF file")
-      ("output,o", boost::program_options::value<boost::filesystem::path>(&c.matchfile)->default_value("query.tsv.gz"), "gzipped output file for query SVs")
+      ("anno,a", boost::program_options::value<std::vector<boost::filesystem::path> >(&annoFiles)->default_value(std::vector<boost::filesystem::path>(1, "anno.bcf"), "anno.bcf"), "output annotation VCF/BCF file, once (numbered per -d file) or per -d file")
+      ("noanno", "do not write and index the annotation VCF/BCF file")
+      ("output,o", boost::program_options::value<boost::filesystem::path>(&c.matchfile)->default_value("query.tsv.gz"), "BGZF-compressed output file for query SVs (- for stdout)")
+      ("uncompressed", "write uncompressed output file and query BCF (e.g., for pipes)")
+      ("tabix,x", "tabix index the output file on query.chr and query.start")
+      ("vcf,v", boost::program_options::value<boost::filesystem::path>(&c.outvcf), "annotated query BCF output file (optional, - for stdout)")
+      ("threads", boost::program_options::value<int32_t>(&c.threads)->default_value(1), "number of threads")
       ;
 
 
     boost::program_options::options_description svopt("SV annotation file options");
     svopt.add_options()
-      ("db,d", boost::program_options::value<boost::filesystem::path>(&c.db), "database VCF/BCF file")
+      ("db,d", boost::program_options::value<std::vector<boost::filesystem::path> >(&dbFiles), "database VCF/BCF file or binary database (sansa dbindex), repeat for multiple databases")
       ("bpoffset,b", boost::program_options::value<int32_t>(&c.bpwindow)->default_value(50), "max. breakpoint offset")
       ("ratio,r", boost::program_options::value<float>(&c.sizediff)->default_value(0.8), "min. reciprocal overlap")
       ("strategy,s", boost::program_options::value<std::string>(&strategy)->default_value("best"), "matching strategy [best|all]")
       ("notype,n", "do not require matching SV types")
       ("nomatch,m", "report SVs without match in database (ANNOID=None)")
+      ("db-fields", boost::program_options::value<std::vector<std::string> >(&dbFields), "database fields to report, e.g. ID,EUR_AF, once or per -d file")
+      ("stream", "stream coordinate-sorted query and database files (bounded memory)")
+      ("lazy", "fetch only indexed database regions near query SVs (small query files)")
+      ("memo", boost::program_options::value<uint32_t>(&c.memoSize)->default_value(100000), "max. cached query SV keys for repeated SVs (0: no caching)")
       ;
       
     boost::program_options::options_description gtfopt("BED/GTF/GFF3 annotation file options");
     gtfopt.add_options()
-      ("gtf,g", boost::program_options::value<boost::filesystem::path>(&c.gtfFile), "gtf/gff3/bed file")
-      ("id,i", boost::program_options::value<std::string>(&c.idname)->default_value("gene_name"), "gtf/gff3 attribute")
-      ("feature,f", boost::program_options::value<std::string>(&c.feature)->default_value("gene"), "gtf/gff3 feature")
+      ("gtf,g", boost::program_options::value<std::vector<boost::filesystem::path> >(&gtfFiles), "gtf/gff3/bed file or feature index (sansa featureindex), repeat for multiple tracks")
+      ("id,i", boost::program_options::value<std::vector<std::string> >(&idnames)->default_value(std::vector<std::string>(1, "gene_name"), "gene_name"), "gtf/gff3 attribute, once or per -g file")
+      ("feature,f", boost::program_options::value<std::vector<std::string> >(&features)->default_value(std::vector<std::string>(1, "gene"), "gene"), "gtf/gff3 feature(s), e.g. gene,exon, once or per -g file")
       ("distance,t", boost::program_options::value<int32_t>(&c.maxDistance)->default_value(1000), "max. distance (0: overlapping features only)")
       ("contained,c", "report contained genes (useful for CNVs but potentially long list of genes)")
+      ("summary,u", "report number of contained features, contained protein-coding features and covered fraction of the SV")
       ;
     
     boost::program_options::options_description hidden("Hidden options");
     hidden.add_options()
-      ("input-file", boost::program_options::value<boost::filesystem::path>(&c.infile), "query VCF/BCF file")
+      ("input-file", boost::program_options::value<boost::filesystem::path>(&c.infile), "query VCF/BCF file (- for stdin)")
       ;
     
     boost::program_options::positional_options_description pos_args;
@@ -181,10 +356,17 @@ namespace sansa
       return -1;
     }
 
-    // SV database
+    // Query from stdin
+    bool pipedInput = (c.infile.string() == "-");
+    if ((pipedInput) && ((!vm.count("db")) || (vm.count("lazy")))) {
+      std::cerr << "Reading the query from stdin requires -d and cannot be combined with --lazy." << std::endl;
+      return 1;
+    }
+
+    // SV databases
     if (!vm.count("db")) {
       // Set input SV file as DB to fill chr array
-      c.db = c.infile;
+      dbFiles.push_back(c.infile);
     }
     
     // Match SV types
@@ -198,6 +380,19 @@ namespace sansa
     // Report contained genes
     if (vm.count("contained")) c.containedGenes = true;
     else c.containedGenes = false;
+    if (vm.count("summary")) c.featureSummary = true;
+    else c.featureSummary = false;
+    if (vm.count("tabix")) c.tabix = true;
+    else c.tabix = false;
+    if (vm.count("uncompressed")) c.uncompressed = true;
+    else c.uncompressed = false;
+    
+    // Check threads
+    if (c.threads < 1) c.threads = 1;
+#ifndef OPENMP
+    if (c.threads > 1) std::cerr << "Warning: sansa was compiled without OpenMP support, SV matching uses a single thread." << std::endl;
+#endif
+    c.batchsize = 1024 * c.threads;
     
     // Check size ratio
     if (c.sizediff < 0) c.sizediff = 0;
@@ -207,16 +402,95 @@ namespace sansa
     if (strategy == "all") c.bestMatch = false;
     else c.bestMatch = true;
 
+    // Database fields and annotation files
+    if (((dbFields.size() > 1) && (dbFields.size() != dbFiles.size())) || ((annoFiles.size() > 1) && (annoFiles.size() != dbFiles.size()))) {
+      std::cerr << "Please specify -a and --db-fields either once or once per -d file." << std::endl;
+      return 1;
+    }
+    for(uint32_t k = 0; k < dbFiles.size(); ++k) {
+      DatabaseConfig d;
+      d.db = dbFiles[k];
+      if (vm.count("noanno")) d.annofile.clear();
+      else if (annoFiles.size() > 1) d.annofile = annoFiles[k];
+      else d.annofile = _suffixedPath(annoFiles[0], k);
+      if (!dbFields.empty()) _parseDbFields(dbFields[std::min<std::size_t>(k, dbFields.size() - 1)], d.dbFields);
+
+      // Binary SV database
+      if (is_svdb(d.db)) d.dbFormat = 1;
+      else d.dbFormat = 0;
+      c.dbs.push_back(d);
+    }
+
+    // Streaming sort-merge mode
+    bool binaryDb = false;
+    for(uint32_t k = 0; k < c.dbs.size(); ++k) {
+      if (c.dbs[k].dbFormat == 1) binaryDb = true;
+    }
+    if (vm.count("stream")) {
+      if (binaryDb) {
+	std::cerr << "Streaming mode requires VCF/BCF databases, binary databases are memory-mapped anyway." << std::endl;
+	return 1;
+      }
+      c.streaming = true;
+    } else c.streaming = false;
+
+    // Lazy indexed database fetching
+    if (vm.count("lazy")) {
+      if ((binaryDb) || (c.streaming)) {
+	std::cerr << "Lazy mode requires indexed VCF/BCF databases and cannot be combined with --stream." << std::endl;
+	return 1;
+      }
+      c.lazy = true;
+    } else c.lazy = false;
+
+    // Standard output
+    if ((c.matchfile.string() == "-") && (vm.count("vcf")) && (c.outvcf.string() == "-")) {
+      std::cerr << "Only one of -o and -v can be written to stdout." << std::endl;
+      return 1;
+    }
+    if ((c.tabix) && ((c.matchfile.string() == "-") || (c.uncompressed))) {
+      std::cerr << "Tabix indexing requires a BGZF-compressed output file." << std::endl;
+      return 1;
+    }
+
     // Check output directory
     if (!_outfileValid(c.matchfile)) return 1;
-    if (!_outfileValid(c.annofile)) return 1;
-
-    // GTF/GFF3/BED
-    if (vm.count("gtf")) {
-      if (is_gff3(c.gtfFile)) c.gtfFileFormat = 2; // GFF3
-      else if (is_gtf(c.gtfFile)) c.gtfFileFormat = 0; // GTF/GFF2
-      else c.gtfFileFormat = 1;  // BED
-    } else c.gtfFileFormat = -1;
+    if (vm.count("vcf")) {
+      if (!_outfileValid(c.outvcf)) return 1;
+    }
+    for(uint32_t k = 0; k < c.dbs.size(); ++k) {
+      if ((c.dbs[k].dbFormat == 0) && (!c.dbs[k].annofile.empty())) {
+	if (!_outfileValid(c.dbs[k].annofile)) return 1;
+      }
+    }
+
+    // GTF/GFF3/BED tracks
+    if (((idnames.size() > 1) && (idnames.size() != gtfFiles.size())) || ((features.size() > 1) && (features.size() != gtfFiles.size()))) {
+      std::cerr << "Please specify -i and -f either once or once per -g file." << std::endl;
+      return 1;
+    }
+    for(uint32_t t = 0; t < gtfFiles.size(); ++t) {
+      FeatureConfig fc;
+      fc.gtfFile = gtfFiles[t];
+      fc.idname = idnames[std::min<std::size_t>(t, idnames.size() - 1)];
+      fc.gtfFileFormat = _featureFileFormat(fc.gtfFile);
+
+      // One track per feature type, BED files carry a single feature set
+      std::vector<std::string> ftypes;
+      _parseDbFields(features[std::min<std::size_t>(t, features.size() - 1)], ftypes);
+      if (ftypes.empty()) ftypes.push_back("gene");
+      if ((fc.gtfFileFormat == 3) && (ftypes.size() > 1)) {
+	std::cerr << "Feature index " << fc.gtfFile.string() << " holds a single feature type, please build one index per feature type." << std::endl;
+	return 1;
+      }
+      if (fc.gtfFileFormat == 1) ftypes.resize(1);
+      for(uint32_t k = 0; k < ftypes.size(); ++k) {
+	if (std::find(ftypes.begin(), ftypes.begin() + k, ftypes[k]) != ftypes.begin() + k) continue;
+	fc.feature = ftypes[k];
+	c.tracks.push_back(fc);
+      }
+    }
+    if (c.tracks.empty()) c.featureSummary = false;
 
     // Show cmd
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
@@ -14,6 +14,8 @@
 #include <htslib/sam.h>
 
 #include "util.h"
+#include "fieldparser.h"
+#include "featurereader.h"
 
 namespace sansa
 {
@@ -23,6 +25,7 @@ namespace sansa
   parseBEDAll(TConfig const& c, TGenomicRegions& overlappingRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] " << "BED feature parsing" << std::endl;
+    boost::posix_time::ptime parseStart = boost::posix_time::microsec_clock::local_time();
     
     // Check gzip
     if (!is_gz(c.gtfFile)) {
@@ -31,66 +34,59 @@ namespace sansa
     }
 
     // Map IDs to integer
-    typedef std::map<std::string, int32_t> TIdMap;
-    TIdMap idMap;
+    FeatureIdInterner idMap;
+    ChrNameCache<typename TConfig::TChrMap> chrCache(c.nchr);
 
     // Keep track of unique exon IDs
     int32_t eid = 0;
 
     // Parse BED
-    std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
-    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
-    dataIn.push(boost::iostreams::gzip_decompressor());
-    dataIn.push(file);
-    std::istream instream(&dataIn);
-    std::string gline;
-    while(std::getline(instream, gline)) {
+    FeatureLineReader reader;
+    if (!reader.open(c)) return 0;
+    std::string_view gline;
+    std::string_view const sep(" \t,;");
+    while(reader.next(gline)) {
       if ((gline.size()) && (gline[0] == '#')) continue;
-      typedef boost::tokenizer< boost::char_separator<char> > Tokenizer;
-      boost::char_separator<char> sep(" \t,;");
-      Tokenizer tokens(gline, sep);
-      Tokenizer::iterator tokIter = tokens.begin();
-      if (tokIter==tokens.end()) {
+      std::string_view line(gline);
+      std::string_view tok;
+      if (!_nextToken(line, sep, tok)) {
 	std::cerr << "Empty line in BED file!" << std::endl;
 	return 0;
       }
-      std::string chrName=*tokIter++;
-      if (c.nchr.find(chrName) == c.nchr.end()) continue;
-      int32_t chrid = c.nchr.find(chrName)->second;
-      if (tokIter == tokens.end()) {
+      int32_t chrid = chrCache.find(tok);
+      if (chrid == -1) continue;
+      int32_t start = 0;
+      int32_t end = 0;
+      if ((!_nextToken(line, sep, tok)) || (!_parseInt32(tok, start)) || (!_nextToken(line, sep, tok)) || (!_parseInt32(tok, end))) {
 	std::cerr << "Corrupted BED file!" << std::endl;
 	return 0;
       }
-      int32_t start = boost::lexical_cast<int32_t>(*tokIter++);
-      int32_t end = boost::lexical_cast<int32_t>(*tokIter++);
-      if (tokIter == tokens.end()) {
+      std::string_view val;
+      if (!_nextToken(line, sep, val)) {
 	std::cerr << "Name is missing in BED file!" << std::endl;
 	return 0;
       }
-      std::string val = *tokIter++;
       char strand = '*';
-      std::string biotype = "NA";
-      if (tokIter != tokens.end()) {
-	++tokIter; // skip score
-	strand = boost::lexical_cast<char>(*tokIter++);
-	biotype = *tokIter++;
+      std::string_view biotype("NA");
+      if (_nextToken(line, sep, tok)) {
+	// Skip score
+	if ((!_nextToken(line, sep, tok)) || (tok.size() != 1)) {
+	  std::cerr << "Corrupted BED file!" << std::endl;
+	  return 0;
+	}
+	strand = tok[0];
+	if (!_nextToken(line, sep, biotype)) biotype = "NA";
       }
-      int32_t idval = geneIds.size();
-      typename TIdMap::const_iterator idIter = idMap.find(val);
-      if (idIter == idMap.end()) {
-	idMap.insert(std::make_pair(val, idval));
-	geneIds.push_back(val);
-	if (biotype == "protein_coding") pCoding.push_back(true);
-	else pCoding.push_back(false);
-      } else idval = idIter->second;
+      int32_t idval;
+      if (idMap.intern(val, geneIds, idval)) pCoding.push_back(biotype == "protein_coding");
       // BED is 0-based and right-open, no need to convert
       if (start > end) {
 	std::cerr << "Feature start is greater than feature end!" << std::endl;
 	return 0;
       }
-      //std::cerr << geneIds[idval] << "\t" << start << "\t" << end << std::endl;
       _insertInterval(overlappingRegions[chrid], start, end, strand, idval, eid++);
     }
+    _parseRate("BED", reader.bytes, parseStart);
     return geneIds.size();
   }   
 
@@ -113,29 +109,7 @@ namespace sansa
     parseBEDAll(c, overlappingRegions, geneIds, pCoding);
 
     // Make intervals non-overlapping for each label
-    for(uint32_t refIndex = 0; refIndex < overlappingRegions.size(); ++refIndex) {
-      // Sort by ID
-      std::sort(overlappingRegions[refIndex].begin(), overlappingRegions[refIndex].end(), SortIntervalLabel<IntervalLabel>());
-      int32_t runningId = -1;
-      char runningStrand = '*';
-      typedef boost::icl::interval_set<uint32_t> TIdIntervals;
-      typedef typename TIdIntervals::interval_type TIVal;
-      TIdIntervals idIntervals;
-      for(uint32_t i = 0; i < overlappingRegions[refIndex].size(); ++i) {
-	if (overlappingRegions[refIndex][i].lid != runningId) {
-	  for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) {
-	    //std::cerr << "merged\t" << geneIds[runningId] << "\t" << it->lower() << "\t" << it->upper() << std::endl;  
-	    gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
-	  }
-	  idIntervals.clear();
-	  runningId = overlappingRegions[refIndex][i].lid;
-	  runningStrand = overlappingRegions[refIndex][i].strand;
-	}
-	idIntervals.insert(TIVal::right_open(overlappingRegions[refIndex][i].start, overlappingRegions[refIndex][i].end));
-      }
-      // Process last id
-      for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
-    }
+    for(uint32_t refIndex = 0; refIndex < overlappingRegions.size(); ++refIndex) _mergeLabelIntervals(overlappingRegions[refIndex], gRegions[refIndex]);
     return geneIds.size();
   }
 
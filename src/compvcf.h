@@ -38,6 +38,7 @@
 #include "edlib.h"
 #include "version.h"
 #include "util.h"
+#include "decoder.h"
 
 namespace sansa
 {
@@ -82,6 +83,8 @@ namespace sansa
     int32_t maxac;
     float sizeratio;
     float divergence;
+    int32_t threads;
+    htsThreadPool tpool;
     boost::filesystem::path vcffile;
     boost::filesystem::path base;
     std::string outprefix;
@@ -170,30 +173,15 @@ namespace sansa
     
     // Load bcf file
     htsFile* ifile = hts_open(filename.c_str(), "r");
+    _attachThreadPool(ifile, c.tpool);
     bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
 
     // VCF fields
-    int32_t nsvend = 0;
-    int32_t* svend = NULL;
-    int32_t ninslen = 0;
-    int32_t* inslen = NULL;
-    int32_t nconsbp = 0;
-    int32_t* consbp = NULL;
     int32_t svEndVal = -1;
-    int32_t nsvt = 0;
-    char* svt = NULL;
     std::string svtVal;
-    int32_t ncons = 0;
-    char* cons = NULL;
-    int32_t nchr2 = 0;
-    char* chr2 = NULL;
-    int32_t npos2 = 0;
-    int32_t* pos2 = NULL;
-    int32_t nct = 0;
-    char* ct = NULL;
+    std::string consVal;
     std::string ctVal;
-    int ngt = 0;
-    int32_t* gt = NULL;
     int32_t inslenVal = -1;
     int32_t svLenVal = 0;
     std::string chr2Name;
@@ -202,7 +190,10 @@ namespace sansa
     std::cerr << '[' << boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()) << "] " << "Parsing VCF/BCF file " << filename << std::endl;
     uint32_t svcounter = 0;
     bcf1_t* rec = bcf_init1();
+    uint64_t nrec = 0;
+    boost::posix_time::ptime decodeStart = boost::posix_time::microsec_clock::local_time();
     while (bcf_read(ifile, hdr, rec) == 0) {
+      ++nrec;
       bcf_unpack(rec, BCF_UN_INFO);
 
       // Check SV type
@@ -210,12 +201,10 @@ namespace sansa
       ctVal = "NA";
       svEndVal = -1;
       inslenVal = -1;
-      if (_isKeyPresent(hdr, "SVTYPE")) {
-	if (bcf_get_info_string(hdr, rec, "SVTYPE", &svt, &nsvt) > 0) {
-	  svtVal = std::string(svt);
-	  if (_isKeyPresent(hdr, "CT")) {
-	    bcf_get_info_string(hdr, rec, "CT", &ct, &nct);
-	    ctVal = std::string(ct);
+      if (dec.present(SVD_SVTYPE)) {
+	if (dec.infoString(rec, SVD_SVTYPE, svtVal)) {
+	  if (dec.present(SVD_CT)) {
+	    dec.infoString(rec, SVD_CT, ctVal);
 	  } else {
 	    if (svtVal == "INS") ctVal = "NtoN";
 	    else if (svtVal == "DEL") ctVal = "3to5";
@@ -256,36 +245,31 @@ namespace sansa
       }
 
       // SV end
-      if (_isKeyPresent(hdr, "END")) {
-	if (bcf_get_info_int32(hdr, rec, "END", &svend, &nsvend) > 0) svEndVal = *svend;
-      }
+      dec.infoInt32(rec, SVD_END, svEndVal);
       if (svEndVal == -1) {
 	if (svtVal == "DEL") {
-	  if (_isKeyPresent(hdr, "SVLEN")) {
-	    if (bcf_get_info_int32(hdr, rec, "SVLEN", &svend, &nsvend) > 0) {
-	      if (*svend < 0) svEndVal = rec->pos - (*svend);
-	      else svEndVal = rec->pos + (*svend);
-	    }
+	  int32_t svlenVal = 0;
+	  if (dec.infoInt32(rec, SVD_SVLEN, svlenVal)) {
+	    if (svlenVal < 0) svEndVal = rec->pos - svlenVal;
+	    else svEndVal = rec->pos + svlenVal;
 	  }
 	}
       }
 
       // Insertion length
-      if (_isKeyPresent(hdr, "INSLEN")) {
-	if (bcf_get_info_int32(hdr, rec, "INSLEN", &inslen, &ninslen) > 0) inslenVal = *inslen;
+      if (dec.present(SVD_INSLEN)) {
+	dec.infoInt32(rec, SVD_INSLEN, inslenVal);
       } else if (svtVal  == "INS") {
-	if (_isKeyPresent(hdr, "SVLEN")) {
-	  if (bcf_get_info_int32(hdr, rec, "SVLEN", &inslen, &ninslen) > 0) inslenVal = *inslen;
-	}
+	dec.infoInt32(rec, SVD_SVLEN, inslenVal);
       }
 
       // BNDs
       int32_t svStartVal = rec->pos;
       if (svtVal == "BND") {
 	int32_t pos2val = -1;
-	if ((_isKeyPresent(hdr, "CHR2")) && (_isKeyPresent(hdr, "POS2"))) {
-	  if (bcf_get_info_int32(hdr, rec, "POS2", &pos2, &npos2) > 0) pos2val = *pos2;
-	  if (bcf_get_info_string(hdr, rec, "CHR2", &chr2, &nchr2) > 0) chr2Name = std::string(chr2);
+	if ((dec.present(SVD_CHR2)) && (dec.present(SVD_POS2))) {
+	  dec.infoInt32(rec, SVD_POS2, pos2val);
+	  dec.infoString(rec, SVD_CHR2, chr2Name);
 	} else {
 	  // Parse ALT
 	  std::vector<std::size_t> posBND;
@@ -394,10 +378,10 @@ namespace sansa
 
 	// Check genotypes
 	bcf_unpack(rec, BCF_UN_ALL);
-	bcf_get_format_int32(hdr, rec, "GT", &gt, &ngt);
+	int32_t* gt = dec.formatInt32(rec, SVD_GT);
 	sv.gt.resize(c.samples.size(), -1); // Missing GT initialization
 	int32_t gtsum = 0;
-	for (int i = 0; i < bcf_hdr_nsamples(hdr); ++i) {
+	for (int i = 0; (gt != NULL) && (i < bcf_hdr_nsamples(hdr)); ++i) {
 	  if ((bcf_gt_allele(gt[i*2]) != -1) && (bcf_gt_allele(gt[i*2 + 1]) != -1)) {
 	    std::string sname = hdr->samples[i];
 	    if (smap.find(sname) != smap.end()) {
@@ -411,13 +395,8 @@ namespace sansa
 	// Min. and max. allele count
 	if ((gtsum >= c.minac) && (gtsum < c.maxac)) {
 	  sv.allele = "";
-	  if (_isKeyPresent(hdr, "CONSENSUS")) {
-	    if (bcf_get_info_string(hdr, rec, "CONSENSUS", &cons, &ncons) > 0) {
-	      if (bcf_get_info_int32(hdr, rec, "CONSBP", &consbp, &nconsbp) > 0) {
-		sv.allele = std::string(cons);
-		sv.consBp = *consbp;
-	      }
-	    }
+	  if (dec.infoString(rec, SVD_CONSENSUS, consVal)) {
+	    if (dec.infoInt32(rec, SVD_CONSBP, sv.consBp)) sv.allele = consVal;
 	  }
 	  sv.id = std::string(rec->d.id);
 	  if (sv.id == ".") {
@@ -437,19 +416,9 @@ namespace sansa
 	//std::cerr << qualVal << '\t' << pass << '\t' << svLenVal << std::endl;
       }
     }
+    _decodeRate(nrec, decodeStart);
     bcf_destroy(rec);
 
-    // Clean-up
-    if (svend != NULL) free(svend);
-    if (inslen != NULL) free(inslen);
-    if (consbp != NULL) free(consbp);
-    if (svt != NULL) free(svt);
-    if (gt != NULL) free(gt);
-    if (ct != NULL) free(ct);
-    if (cons != NULL) free(cons);
-    if (chr2 != NULL) free(chr2);
-    if (pos2 != NULL) free(pos2);
-
     // Close VCF
     bcf_hdr_destroy(hdr);
     bcf_close(ifile);
@@ -460,19 +429,29 @@ namespace sansa
   inline int
   compvcfRun(CompvcfConfig& c) {
 
+    // Shared htslib thread pool
+    ThreadPoolGuard poolGuard(c.tpool, c.threads);
+
     // Load SVs
+    boost::posix_time::ptime stage = boost::posix_time::microsec_clock::local_time();
     std::vector<CompSVRecord> basesv;
     if (!_loadCompSVs(c, c.base.string(), basesv)) return -1;
+    _stageTime("Base SV loading", stage);
     
+    stage = boost::posix_time::microsec_clock::local_time();
     std::vector<CompSVRecord> compsv;
     if (!_loadCompSVs(c, c.vcffile.string(), compsv)) return -1;
+    _stageTime("Comparison SV loading", stage);
+    _destroyThreadPool(c.tpool);
 
     // Sort SVs
+    stage = boost::posix_time::microsec_clock::local_time();
     sort(basesv.begin(), basesv.end());
     sort(compsv.begin(), compsv.end());
 
     // Recall, precission, GT concordance
     compareSVs(c, basesv, compsv);
+    _stageTime("SV comparison", stage);
 
     // Metrics
     uint32_t tp_base = 0;
@@ -553,6 +532,7 @@ namespace sansa
       ("pass,p", "Filter sites for PASS")
       ("ignore,i", "Ignore duplicate IDs")
       ("ct,c", "Require matching CT value in addition to SV type")
+      ("threads", boost::program_options::value<int32_t>(&c.threads)->default_value(1), "number of decompression threads")
       ;
     
     // Define hidden options
@@ -581,6 +561,9 @@ namespace sansa
       return 0;
     }
     
+    // Check threads
+    if (c.threads < 1) c.threads = 1;
+
     // Filter for PASS
     if (vm.count("pass")) c.filterForPass = true;
     else c.filterForPass = false;
@@ -0,0 +1,133 @@
+#ifndef DBINDEX_H
+#define DBINDEX_H
+
+#include <fstream>
+#include <iomanip>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/filesystem.hpp>
+
+#include "annotate.h"
+#include "svdb.h"
+
+namespace sansa
+{
+
+  template<typename TConfig>
+  inline int32_t
+  runDbIndex(TConfig& c, DatabaseConfig const& d, boost::filesystem::path const& outfile) {
+
+    // Database sequence dictionary
+    int32_t maxRID = 0;
+    if (!_loadChrNames(c, d.db, maxRID)) return 1;
+    typename TConfig::TChrMap nchr = c.nchr;
+
+    // Shared htslib thread pool
+    ThreadPoolGuard poolGuard(c.tpool, c.threads);
+
+    // Parse DB
+    std::vector<SV> svs;
+    DbFields fields;
+    bool hasCT = false;
+    if (!parseDB(c, d, svs, fields, hasCT)) {
+      std::cerr << "Sansa couldn't parse database!" << std::endl;
+      return 1;
+    }
+
+    // Write binary database
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Write binary SV annotation database" << std::endl;
+    fields.attach();
+    BreakpointGrid grid;
+    grid.build(c, svs.empty() ? NULL : &svs[0], svs.empty() ? NULL : &svs[0] + svs.size());
+    if (!writeSVDatabase(outfile, nchr, hasCT, svs, fields, grid)) return 1;
+    _destroyThreadPool(c.tpool);
+
+    // End
+    now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Done." << std::endl;
+    return 0;
+  }
+
+
+  int dbindex(int argc, char** argv) {
+    AnnotateConfig c;
+    DatabaseConfig d;
+    d.dbFormat = 0;
+    boost::filesystem::path outfile;
+    std::string dbFields;
+
+    // Parameter
+    boost::program_options::options_description generic("Generic options");
+    generic.add_options()
+      ("help,?", "show help message")
+      ("anno,a", boost::program_options::value<boost::filesystem::path>(&d.annofile)->default_value("anno.bcf"), "output annotation VCF/BCF file")
+      ("output,o", boost::program_options::value<boost::filesystem::path>(&outfile)->default_value("anno.sdb"), "output binary SV database")
+      ("db-fields", boost::program_options::value<std::string>(&dbFields), "database fields to store, e.g. ID,EUR_AF")
+      ("bpoffset,b", boost::program_options::value<int32_t>(&c.bpwindow)->default_value(50), "max. breakpoint offset of the stored breakpoint grid")
+      ("notype,n", "store the breakpoint grid for annotation without matching SV types")
+      ("threads", boost::program_options::value<int32_t>(&c.threads)->default_value(1), "number of compression threads")
+      ;
+
+    boost::program_options::options_description hidden("Hidden options");
+    hidden.add_options()
+      ("input-file", boost::program_options::value<boost::filesystem::path>(&d.db), "database VCF/BCF file")
+      ;
+
+    boost::program_options::positional_options_description pos_args;
+    pos_args.add("input-file", -1);
+
+    boost::program_options::options_description cmdline_options;
+    cmdline_options.add(generic).add(hidden);
+    boost::program_options::options_description visible_options;
+    visible_options.add(generic);
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(cmdline_options).positional(pos_args).run(), vm);
+    boost::program_options::notify(vm);
+
+    // Check command line arguments
+    if ((vm.count("help")) || (!vm.count("input-file"))) {
+      std::cerr << std::endl;
+      std::cerr << "Usage: sansa " << argv[0] << " [OPTIONS] database.bcf" << std::endl;
+      std::cerr << visible_options << "\n";
+      return -1;
+    }
+
+    // Check input file
+    if (!(boost::filesystem::exists(d.db) && boost::filesystem::is_regular_file(d.db) && boost::filesystem::file_size(d.db))) {
+      std::cerr << "Input VCF/BCF file is missing: " << d.db.string() << std::endl;
+      return 1;
+    }
+
+    // Check threads
+    if (c.threads < 1) c.threads = 1;
+
+    // Database fields
+    if (vm.count("db-fields")) _parseDbFields(dbFields, d.dbFields);
+
+    // Breakpoint grid, annotate with the same -b and -n maps it instead of rebuilding it
+    if (vm.count("notype")) c.matchSvType = false;
+    else c.matchSvType = true;
+
+    // Check output directory
+    if (!_outfileValid(outfile)) return 1;
+    if (!_outfileValid(d.annofile)) return 1;
+
+    // Show cmd
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] ";
+    std::cerr << "sansa ";
+    for(int i=0; i<argc; ++i) { std::cerr << argv[i] << ' '; }
+    std::cerr << std::endl;
+
+    return runDbIndex(c, d, outfile);
+  }
+
+}
+
+#endif
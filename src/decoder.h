@@ -0,0 +1,314 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <cstring>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <htslib/vcf.h>
+
+#include "util.h"
+
+namespace sansa
+{
+
+  // INFO and FORMAT keys read by the SV decoder
+  enum SVInfoKey { SVD_SVTYPE, SVD_CT, SVD_CHR2, SVD_POS2, SVD_END, SVD_SVLEN, SVD_SVCLASS, SVD_INSLEN, SVD_CONSENSUS, SVD_CONSBP, SVD_PRECISE, SVD_NINFO };
+  enum SVFormatKey { SVD_GT, SVD_GQ, SVD_DV, SVD_DR, SVD_RV, SVD_RR, SVD_NFORMAT };
+
+  // Integer codes of SVTYPE and CT values
+  enum SVTypeCode { SVT_UNKNOWN, SVT_BND, SVT_TRA, SVT_DEL, SVT_INV, SVT_DUP, SVT_INS, SVT_CNV, SVT_CPX, SVT_CTX, SVT_SCNA, SVT_MCNV, SVT_NCODES };
+  enum CTCode { CT_NA, CT_3TO3, CT_5TO5, CT_3TO5, CT_5TO3, CT_OTHER, CT_NCODES };
+
+  inline int32_t
+  _svTypeCode(std::string const& svt) {
+    static char const* const names[SVT_NCODES] = {"", "BND", "TRA", "DEL", "INV", "DUP", "INS", "CNV", "CPX", "CTX", "SCNA", "MCNV"};
+    for(int32_t i = 1; i < SVT_NCODES; ++i) {
+      if (svt == names[i]) return i;
+    }
+    return SVT_UNKNOWN;
+  }
+
+  inline int32_t
+  _ctCode(std::string const& ct) {
+    static char const* const names[CT_OTHER] = {"NA", "3to3", "5to5", "3to5", "5to3"};
+    for(int32_t i = 0; i < CT_OTHER; ++i) {
+      if (ct == names[i]) return i;
+    }
+    return CT_OTHER;
+  }
+
+  // Numerical SV type of an (SVTYPE, CT) code pair, same values as _decodeOrientation
+  inline int32_t
+  _decodeOrientationCode(int32_t const ct, int32_t const svt) {
+    static int8_t const orientation[SVT_NCODES][CT_NCODES] = {
+      {-1, 0, 1, 2, 3, 4},   // UNKNOWN
+      {5, 5, 6, 7, 8, -1},   // BND
+      {5, 5, 6, 7, 8, -1},   // TRA
+      {2, 0, 1, 2, 3, 4},    // DEL
+      {0, 0, 1, 2, 3, 4},    // INV
+      {3, 0, 1, 2, 3, 4},    // DUP
+      {4, 0, 1, 2, 3, 4},    // INS
+      {9, 0, 1, 2, 3, 4},    // CNV
+      {10, 0, 1, 2, 3, 4},   // CPX
+      {11, 0, 1, 2, 3, 4},   // CTX
+      {12, 0, 1, 2, 3, 4},   // SCNA
+      {13, 0, 1, 2, 3, 4}    // MCNV
+    };
+    return orientation[svt][ct];
+  }
+
+  // Decode Orientation
+  inline int32_t
+  _decodeOrientation(std::string const& value, std::string const& svt) {
+    return _decodeOrientationCode(_ctCode(value), _svTypeCode(svt));
+  }
+
+  // SV record decoder, header ids and types are resolved once per file
+  // INFO values are read in place from the unpacked record and FORMAT buffers are reused across records
+  // The INFO accessors are const and can be shared by threads
+  struct SVRecordDecoder {
+    bcf_hdr_t* hdr;
+    int32_t infoId[SVD_NINFO];
+    bool infoPresent[SVD_NINFO];   // Key is in the header dictionary
+    bool infoValid[SVD_NINFO];     // Key is an INFO field of the expected type
+    int32_t fmtId[SVD_NFORMAT];
+    int32_t gqType;
+    int32_t* fmtBuf[SVD_NFORMAT];
+    int32_t nFmtBuf[SVD_NFORMAT];
+    float* gqf;
+    int32_t ngqf;
+
+    SVRecordDecoder() : hdr(NULL), gqType(-1), gqf(NULL), ngqf(0) {
+      for(int32_t k = 0; k < SVD_NFORMAT; ++k) {
+	fmtBuf[k] = NULL;
+	nFmtBuf[k] = 0;
+      }
+    }
+
+    explicit SVRecordDecoder(bcf_hdr_t* h) : hdr(NULL), gqType(-1), gqf(NULL), ngqf(0) {
+      for(int32_t k = 0; k < SVD_NFORMAT; ++k) {
+	fmtBuf[k] = NULL;
+	nFmtBuf[k] = 0;
+      }
+      init(h);
+    }
+
+    // Resolve the header dictionary ids and types of a new file
+    void init(bcf_hdr_t* h) {
+      static char const* const infoKeys[SVD_NINFO] = {"SVTYPE", "CT", "CHR2", "POS2", "END", "SVLEN", "SVCLASS", "INSLEN", "CONSENSUS", "CONSBP", "PRECISE"};
+      static int32_t const infoTypes[SVD_NINFO] = {BCF_HT_STR, BCF_HT_STR, BCF_HT_STR, BCF_HT_INT, BCF_HT_INT, BCF_HT_INT, BCF_HT_STR, BCF_HT_INT, BCF_HT_STR, BCF_HT_INT, BCF_HT_FLAG};
+      static char const* const fmtKeys[SVD_NFORMAT] = {"GT", "GQ", "DV", "DR", "RV", "RR"};
+      hdr = h;
+      for(int32_t k = 0; k < SVD_NINFO; ++k) {
+	infoId[k] = bcf_hdr_id2int(hdr, BCF_DT_ID, infoKeys[k]);
+	infoPresent[k] = (infoId[k] >= 0);
+	infoValid[k] = ((bcf_hdr_idinfo_exists(hdr, BCF_HL_INFO, infoId[k])) && ((int32_t) bcf_hdr_id2type(hdr, BCF_HL_INFO, infoId[k]) == infoTypes[k]));
+      }
+      for(int32_t k = 0; k < SVD_NFORMAT; ++k) fmtId[k] = bcf_hdr_id2int(hdr, BCF_DT_ID, fmtKeys[k]);
+      gqType = -1;
+      if (bcf_hdr_idinfo_exists(hdr, BCF_HL_FMT, fmtId[SVD_GQ])) gqType = bcf_hdr_id2type(hdr, BCF_HL_FMT, fmtId[SVD_GQ]);
+    }
+
+    ~SVRecordDecoder() {
+      for(int32_t k = 0; k < SVD_NFORMAT; ++k) {
+	if (fmtBuf[k] != NULL) free(fmtBuf[k]);
+      }
+      if (gqf != NULL) free(gqf);
+    }
+
+    bool present(int32_t const key) const {
+      return infoPresent[key];
+    }
+
+    bool formatPresent(int32_t const key) const {
+      return (fmtId[key] >= 0);
+    }
+
+    bcf_info_t* _info(bcf1_t* rec, int32_t const key) const {
+      if (!infoValid[key]) return NULL;
+      bcf_info_t* info = bcf_get_info_id(rec, infoId[key]);
+      if ((info == NULL) || (info->vptr == NULL) || (info->len <= 0)) return NULL;
+      return info;
+    }
+
+    // String INFO value, val is left untouched if the record lacks the key
+    bool infoString(bcf1_t* rec, int32_t const key, std::string& val) const {
+      bcf_info_t* info = _info(rec, key);
+      if (info == NULL) return false;
+      char const* str = (char const*) info->vptr;
+      val.assign(str, strnlen(str, info->len));
+      return true;
+    }
+
+    // First value of an integer INFO field, missing values are bcf_int32_missing
+    bool infoInt32(bcf1_t* rec, int32_t const key, int32_t& val) const {
+      bcf_info_t* info = _info(rec, key);
+      if (info == NULL) return false;
+      if (info->type == BCF_BT_INT8) {
+	int8_t v = *(int8_t*) info->vptr;
+	if (v == bcf_int8_vector_end) return false;
+	val = (v == bcf_int8_missing) ? bcf_int32_missing : v;
+      } else if (info->type == BCF_BT_INT16) {
+	int16_t v;
+	std::memcpy(&v, info->vptr, sizeof(v));
+	if (v == bcf_int16_vector_end) return false;
+	val = (v == bcf_int16_missing) ? bcf_int32_missing : v;
+      } else if (info->type == BCF_BT_INT32) {
+	int32_t v;
+	std::memcpy(&v, info->vptr, sizeof(v));
+	if (v == bcf_int32_vector_end) return false;
+	val = v;
+      } else return false;
+      return true;
+    }
+
+    bool infoFlag(bcf1_t* rec, int32_t const key) const {
+      return ((infoValid[key]) && (bcf_get_info_id(rec, infoId[key]) != NULL));
+    }
+
+    // SVTYPE of the record, falls back to a symbolic ALT
+    bool svType(bcf1_t* rec, std::string& svtval) const {
+      if (infoString(rec, SVD_SVTYPE, svtval)) return true;
+      if (rec->n_allele < 2) return false;
+      char const* alt = rec->d.allele[1];
+      std::size_t len = std::strlen(alt);
+      if ((len > 2) && (alt[0] == '<') && (alt[len - 1] == '>')) {
+	svtval.assign(alt + 1, len - 2);
+	return true;
+      }
+      return false;
+    }
+
+    // FORMAT integer values in a reused buffer, NULL if the key is missing
+    int32_t* formatInt32(bcf1_t* rec, int32_t const key) {
+      if (fmtId[key] < 0) return NULL;
+      if (bcf_get_format_values(hdr, rec, bcf_hdr_int2id(hdr, BCF_DT_ID, fmtId[key]), (void**) &fmtBuf[key], &nFmtBuf[key], BCF_HT_INT) <= 0) return NULL;
+      return fmtBuf[key];
+    }
+
+    float* formatGQFloat(bcf1_t* rec) {
+      if (fmtId[SVD_GQ] < 0) return NULL;
+      if (bcf_get_format_values(hdr, rec, bcf_hdr_int2id(hdr, BCF_DT_ID, fmtId[SVD_GQ]), (void**) &gqf, &ngqf, BCF_HT_REAL) <= 0) return NULL;
+      return gqf;
+    }
+
+  private:
+    SVRecordDecoder(SVRecordDecoder const&);
+    SVRecordDecoder& operator=(SVRecordDecoder const&);
+  };
+
+  // Decoded SV fields of a database or query record, strings are reused across records
+  struct SVRecordFields {
+    std::string svtval;
+    std::string ctval;
+    std::string chr2Name;
+    std::string svclass;
+    int32_t svEnd;
+    int32_t svlen;
+    int32_t svt;
+    int32_t qual;
+    bool hasCT;
+
+    SVRecordFields() : svEnd(-1), svlen(0), svt(-1), qual(0), hasCT(false) {}
+  };
+
+  inline bool
+  parseAltBnd(SVRecordDecoder const& dec, bcf1_t* rec, SVRecordFields& f, int32_t& endval) {
+    if (endval != -1) return true;  // Done.
+    if (f.svtval != "BND") return false;
+    std::string altAllele = rec->d.allele[1];
+    std::size_t found1 = altAllele.find_first_of("[");
+    std::size_t found2 = altAllele.find_last_of("[");
+    if ((found1 == std::string::npos) && (found2 == std::string::npos)) {
+      found1 = altAllele.find_first_of("]");
+      found2 = altAllele.find_last_of("]");
+    }
+    if ((found1 == std::string::npos) || (found2 == std::string::npos)) return false;
+    if (found1 + 1 >= found2) return false;
+    altAllele = altAllele.substr(found1 + 1, found2 - found1 - 1);
+    std::size_t sepa = altAllele.find_first_of(":");
+    if (sepa == std::string::npos) return false;
+    f.chr2Name = altAllele.substr(0, sepa);
+    endval = boost::lexical_cast<int32_t>(altAllele.substr(sepa+1));
+    if (f.chr2Name == bcf_hdr_id2name(dec.hdr, rec->rid)) {
+      // Fix SV type
+      int32_t pos = rec->pos + 1;
+      if (pos > endval) return false;
+      if (dec.infoString(rec, SVD_SVCLASS, f.svclass)) {
+	if (f.svclass == "DEL") {
+	  f.svtval = "DEL";
+	  f.ctval = "3to5";
+	} else if (f.svclass == "DUP") {
+	  f.svtval = "DUP";
+	  f.ctval = "5to3";
+	} else if (f.svclass == "h2hINV") {
+	  f.svtval = "INV";
+	  f.ctval = "3to3";
+	} else if (f.svclass == "t2tINV") {
+	  f.svtval = "INV";
+	  f.ctval = "5to5";
+	} else if (f.svclass == "INS") {
+	  f.svtval = "INS";
+	  f.ctval = "NtoN";
+	  endval = rec->pos + 2;
+	}
+      }
+      if (f.svtval == "BND") {
+	// Still not fixed, try CT
+	if (f.ctval == "3to5") f.svtval = "DEL";
+	else if (f.ctval == "5to3") f.svtval = "DUP";
+	else if (f.ctval == "3to3") f.svtval = "INV";
+	else if (f.ctval == "5to5") f.svtval = "INV";
+	else if (f.ctval == "NtoN") f.svtval = "INS";
+	else return false;
+      }
+    }
+    return true;
+  }
+
+  // Record decoding throughput
+  inline void
+  _decodeRate(uint64_t const nrec, boost::posix_time::ptime const& start) {
+    double sec = (boost::posix_time::microsec_clock::local_time() - start).total_microseconds() / 1000000.0;
+    std::cerr << '[' << boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()) << "] Decoded " << nrec << " records in " << sec << "s (" << (uint64_t) ((sec > 0) ? nrec / sec : 0) << " records/s)" << std::endl;
+  }
+
+  // Decode the SV fields shared by parseDB and query, false if the record is not a parsable SV
+  inline bool
+  _decodeSVRecord(SVRecordDecoder const& dec, bcf1_t* rec, SVRecordFields& f) {
+    bool parsed = true;
+
+    // Unpack INFO
+    bcf_unpack(rec, BCF_UN_INFO);
+
+    // Parse INFO fields
+    f.svtval = "NA";
+    if (!dec.svType(rec, f.svtval)) parsed = false;
+    f.ctval = "NA";
+    f.hasCT = dec.infoString(rec, SVD_CT, f.ctval);
+    f.chr2Name = bcf_hdr_id2name(dec.hdr, rec->rid);
+    dec.infoString(rec, SVD_CHR2, f.chr2Name);
+    int32_t pos2val = -1;
+    dec.infoInt32(rec, SVD_POS2, pos2val);
+    int32_t endval = -1;
+    dec.infoInt32(rec, SVD_END, endval);
+    int32_t svlenval = 0;
+    dec.infoInt32(rec, SVD_SVLEN, svlenval);
+
+    // Derive proper END and SVLEN
+    f.svEnd = deriveEndPos(rec, f.svtval, pos2val, endval);
+    if (!parseAltBnd(dec, rec, f, f.svEnd)) parsed = false;
+    f.svlen = deriveSvLength(rec, f.svtval, f.svEnd, svlenval);
+
+    // Numerical SV type
+    f.svt = _decodeOrientationCode(_ctCode(f.ctval), _svTypeCode(f.svtval));
+    if (f.svt == -1) parsed = false;
+    f.qual = 0;
+    if (rec->qual > 0) f.qual = (int32_t) (rec->qual);
+    return parsed;
+  }
+
+}
+
+#endif
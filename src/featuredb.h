@@ -0,0 +1,286 @@
+#ifndef FEATUREDB_H
+#define FEATUREDB_H
+
+#include <fstream>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util.h"
+
+namespace sansa
+{
+
+  // Binary feature index layout (version 1)
+  // [FeatureIndexHeader][id attribute][feature type][chromosome dictionary][padding][IntervalLabel arrays][pCoding flags][padding][uint64 id offsets[nids + 1]][id bytes]
+  // Dictionary entries are (uint32 name length, name bytes, uint64 number of labels), label arrays are flattened, start-sorted and stored in dictionary order
+  #define SANSA_FEATUREDB_MAGIC "SANSAFI"
+  #define SANSA_FEATUREDB_VERSION 1
+
+  struct FeatureIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t labelsize;
+    uint32_t format;      // Source format, 0 = gtf, 1 = bed, 2 = gff3
+    uint32_t nchr;
+    uint32_t nids;
+    uint32_t idnameLen;
+    uint32_t featureLen;
+    uint32_t reserved;
+    uint64_t labelOffset;
+    uint64_t nlabels;
+    uint64_t idOffset;
+  };
+
+  inline bool
+  is_featuredb(boost::filesystem::path const& f) {
+    std::ifstream bfile(f.string().c_str(), std::ios_base::binary);
+    if (!bfile) return false;
+    char magic[8];
+    bfile.read(magic, 8);
+    bool featuredb = ((bfile.gcount() == 8) && (std::memcmp(magic, SANSA_FEATUREDB_MAGIC, 8) == 0));
+    bfile.close();
+    return featuredb;
+  }
+
+  // All chromosome names of a gzipped GTF/GFF3/BED file
+  template<typename TConfig>
+  inline bool
+  _loadFeatureChrNames(TConfig& c) {
+    if (!is_gz(c.gtfFile)) {
+      std::cerr << "Feature file is not gzipped!" << std::endl;
+      return false;
+    }
+    char const* sep = "\t";
+    if (c.gtfFileFormat == 1) sep = " \t,;";
+    uint32_t numseq = chrMapSize(c.nchr);
+    std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
+    dataIn.push(boost::iostreams::gzip_decompressor());
+    dataIn.push(file);
+    std::istream instream(&dataIn);
+    std::string gline;
+    std::string lastChr;
+    while(std::getline(instream, gline)) {
+      if ((gline.size()) && (gline[0] == '#')) {
+	if (gline.compare(0, 7, "##FASTA") == 0) break;
+	continue;
+      }
+      std::string::size_type pos = gline.find_first_of(sep);
+      if ((pos == 0) || (pos == std::string::npos)) continue;
+      if (gline.compare(0, pos, lastChr) == 0) continue;
+      lastChr = gline.substr(0, pos);
+      if (c.nchr.find(lastChr) == c.nchr.end()) c.nchr[lastChr] = numseq++;
+    }
+    return true;
+  }
+
+  template<typename TChrMap, typename TGenomicRegions, typename TGeneIds>
+  inline bool
+  writeFeatureIndex(boost::filesystem::path const& outfile, TChrMap const& nchr, uint32_t const format, std::string const& idname, std::string const& feature, TGenomicRegions const& gRegions, TGeneIds const& geneIds, std::vector<bool> const& pCoding) {
+    // Chromosomes in id order
+    std::vector<std::string> chrNames(gRegions.size());
+    for(typename TChrMap::const_iterator itcm = nchr.begin(); itcm != nchr.end(); ++itcm) {
+      if ((itcm->second >= 0) && ((uint32_t) itcm->second < chrNames.size())) chrNames[itcm->second] = itcm->first;
+    }
+
+    FeatureIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SANSA_FEATUREDB_MAGIC, 8);
+    header.version = SANSA_FEATUREDB_VERSION;
+    header.labelsize = sizeof(IntervalLabel);
+    header.format = format;
+    header.nids = geneIds.size();
+    header.idnameLen = idname.size();
+    header.featureLen = feature.size();
+    uint64_t dictSize = 0;
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) {
+      if (gRegions[refIndex].empty()) continue;
+      ++header.nchr;
+      header.nlabels += gRegions[refIndex].size();
+      dictSize += sizeof(uint32_t) + chrNames[refIndex].size() + sizeof(uint64_t);
+    }
+    header.labelOffset = sizeof(FeatureIndexHeader) + idname.size() + feature.size() + dictSize;
+    uint64_t padding = (8 - header.labelOffset % 8) % 8;
+    header.labelOffset += padding;
+    uint64_t codingEnd = header.labelOffset + header.nlabels * sizeof(IntervalLabel) + header.nids;
+    header.idOffset = codingEnd + (8 - codingEnd % 8) % 8;
+
+    std::ofstream ofile(outfile.string().c_str(), std::ios_base::out | std::ios_base::binary);
+    if (!ofile) {
+      std::cerr << "Fail to open output file " << outfile.string() << std::endl;
+      return false;
+    }
+    ofile.write((char const*) &header, sizeof(header));
+    ofile.write(idname.data(), idname.size());
+    ofile.write(feature.data(), feature.size());
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) {
+      if (gRegions[refIndex].empty()) continue;
+      uint32_t len = chrNames[refIndex].size();
+      uint64_t nlabels = gRegions[refIndex].size();
+      ofile.write((char const*) &len, sizeof(len));
+      ofile.write(chrNames[refIndex].data(), len);
+      ofile.write((char const*) &nlabels, sizeof(nlabels));
+    }
+    char const zero[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    ofile.write(zero, padding);
+    // Labels are written field by field into zeroed records, the struct padding never reaches the file
+    std::vector<char> records;
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) {
+      if (gRegions[refIndex].empty()) continue;
+      records.assign(gRegions[refIndex].size() * sizeof(IntervalLabel), 0);
+      for(uint64_t i = 0; i < gRegions[refIndex].size(); ++i) {
+	IntervalLabel const& il = gRegions[refIndex][i];
+	char* rec = &records[i * sizeof(IntervalLabel)];
+	std::memcpy(rec + offsetof(IntervalLabel, start), &il.start, sizeof(il.start));
+	std::memcpy(rec + offsetof(IntervalLabel, end), &il.end, sizeof(il.end));
+	std::memcpy(rec + offsetof(IntervalLabel, strand), &il.strand, sizeof(il.strand));
+	std::memcpy(rec + offsetof(IntervalLabel, lid), &il.lid, sizeof(il.lid));
+      }
+      ofile.write(&records[0], records.size());
+    }
+    for(uint32_t i = 0; i < header.nids; ++i) {
+      char pc = ((i < pCoding.size()) && (pCoding[i])) ? 1 : 0;
+      ofile.write(&pc, 1);
+    }
+    ofile.write(zero, header.idOffset - codingEnd);
+    uint64_t idOffset = 0;
+    for(uint32_t i = 0; i < header.nids; ++i) {
+      ofile.write((char const*) &idOffset, sizeof(idOffset));
+      idOffset += geneIds[i].size();
+    }
+    ofile.write((char const*) &idOffset, sizeof(idOffset));
+    for(uint32_t i = 0; i < header.nids; ++i) ofile.write(geneIds[i].data(), geneIds[i].size());
+    ofile.close();
+    if (!ofile) {
+      std::cerr << "Error writing feature index " << outfile.string() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Loads a feature index into gRegions, which are indexed by the chromosome ids of c.nchr
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds>
+  inline int32_t
+  loadFeatureIndex(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, std::vector<bool>& pCoding) {
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] " << "Load binary feature index" << std::endl;
+
+    int fd = open(c.gtfFile.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Fail to load " << c.gtfFile.string() << std::endl;
+      return 0;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t) sizeof(FeatureIndexHeader))) {
+      std::cerr << "Corrupted feature index " << c.gtfFile.string() << std::endl;
+      close(fd);
+      return 0;
+    }
+    void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      std::cerr << "Fail to memory-map " << c.gtfFile.string() << std::endl;
+      return 0;
+    }
+    char const* base = (char const*) mapped;
+    uint64_t size = st.st_size;
+    bool valid = true;
+
+    // Check header
+    FeatureIndexHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if ((header.version != SANSA_FEATUREDB_VERSION) || (header.labelsize != sizeof(IntervalLabel))) {
+      std::cerr << "Feature index version mismatch, please rebuild " << c.gtfFile.string() << " using sansa featureindex" << std::endl;
+      valid = false;
+    } else if ((header.labelOffset > size) || ((uint64_t) sizeof(FeatureIndexHeader) + header.idnameLen + header.featureLen > header.labelOffset) || (header.nlabels > (size - header.labelOffset) / sizeof(IntervalLabel)) || (header.nids > size - header.labelOffset - header.nlabels * sizeof(IntervalLabel)) || (header.idOffset > size) || (header.nids >= (size - header.idOffset) / sizeof(uint64_t))) {
+      std::cerr << "Corrupted feature index " << c.gtfFile.string() << std::endl;
+      valid = false;
+    }
+
+    // Index keys, BED files have no id attribute or feature type
+    uint64_t offset = sizeof(FeatureIndexHeader);
+    if ((valid) && (header.format != 1)) {
+      std::string idname(base + offset, header.idnameLen);
+      std::string feature(base + offset + header.idnameLen, header.featureLen);
+      if ((idname != c.idname) || (feature != c.feature)) {
+	std::cerr << "Feature index " << c.gtfFile.string() << " was built with -i " << idname << " -f " << feature << ", please rebuild it using sansa featureindex -i " << c.idname << " -f " << c.feature << std::endl;
+	valid = false;
+      }
+    }
+    offset += header.idnameLen + header.featureLen;
+
+    // Flattened features, mapped to the query/database chromosome ids
+    if (valid) {
+      IntervalLabel const* labels = (IntervalLabel const*) (base + header.labelOffset);
+      uint64_t nleft = header.nlabels;
+      uint32_t nchr = 0;
+      for(uint32_t i = 0; i < header.nchr; ++i) {
+	uint32_t len;
+	uint64_t nlabels;
+	if (offset + sizeof(len) > header.labelOffset) break;
+	std::memcpy(&len, base + offset, sizeof(len));
+	if (offset + sizeof(len) + len + sizeof(nlabels) > header.labelOffset) break;
+	std::string chrName(base + offset + sizeof(len), len);
+	offset += sizeof(len) + len;
+	std::memcpy(&nlabels, base + offset, sizeof(nlabels));
+	offset += sizeof(nlabels);
+	if (nlabels > nleft) break;
+	typename TConfig::TChrMap::const_iterator itcm = c.nchr.find(chrName);
+	if ((itcm != c.nchr.end()) && (itcm->second < (int32_t) gRegions.size())) {
+	  bool merge = !gRegions[itcm->second].empty();
+	  gRegions[itcm->second].insert(gRegions[itcm->second].end(), labels, labels + nlabels);
+	  if (merge) std::sort(gRegions[itcm->second].begin(), gRegions[itcm->second].end());
+	}
+	labels += nlabels;
+	nleft -= nlabels;
+	++nchr;
+      }
+      if ((nchr != header.nchr) || (nleft != 0)) {
+	std::cerr << "Corrupted feature index " << c.gtfFile.string() << std::endl;
+	valid = false;
+      }
+    }
+
+    // Feature ids and protein-coding flags
+    if (valid) {
+      char const* coding = base + header.labelOffset + header.nlabels * sizeof(IntervalLabel);
+      uint64_t const* idOffsets = (uint64_t const*) (base + header.idOffset);
+      char const* idData = (char const*) (idOffsets + header.nids + 1);
+      uint64_t dataSize = size - (idData - base);
+      for(uint32_t i = 0; (valid) && (i < header.nids); ++i) {
+	if ((idOffsets[i] > idOffsets[i + 1]) || (idOffsets[i + 1] > idOffsets[header.nids])) valid = false;
+      }
+      if ((!valid) || (idOffsets[header.nids] > dataSize)) {
+	std::cerr << "Corrupted feature index " << c.gtfFile.string() << std::endl;
+	valid = false;
+      } else {
+	geneIds.resize(header.nids);
+	pCoding.resize(header.nids);
+	for(uint32_t i = 0; i < header.nids; ++i) {
+	  geneIds[i].assign(idData + idOffsets[i], idOffsets[i + 1] - idOffsets[i]);
+	  pCoding[i] = (coding[i] != 0);
+	}
+      }
+    }
+    munmap(mapped, size);
+    if (!valid) return 0;
+
+    now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Loaded " << header.nlabels << " features of " << header.nids << " ids." << std::endl;
+    return geneIds.size();
+  }
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef FEATUREINDEX_H
+#define FEATUREINDEX_H
+
+#include <fstream>
+#include <iomanip>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/filesystem.hpp>
+
+#include "track.h"
+
+namespace sansa
+{
+
+  template<typename TConfig>
+  inline int32_t
+  runFeatureIndex(TConfig& c, boost::filesystem::path const& outfile) {
+
+    // Feature file sequence dictionary
+    if (!_loadFeatureChrNames(c)) return 1;
+    int32_t maxRID = chrMapSize(c.nchr);
+
+    // Parse and flatten features
+    typedef std::vector<IntervalLabel> TChromosomeRegions;
+    typedef std::vector<TChromosomeRegions> TGenomicRegions;
+    TGenomicRegions gRegions;
+    gRegions.resize(maxRID, TChromosomeRegions());
+    std::vector<std::string> geneIds;
+    std::vector<bool> pCoding;
+    if (!parseFeatures(c, gRegions, geneIds, pCoding)) {
+      std::cerr << "Error parsing GTF/GFF3/BED file!" << std::endl;
+      return 1;
+    }
+
+    // Write feature index
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Write binary feature index" << std::endl;
+    if (!writeFeatureIndex(outfile, c.nchr, c.gtfFileFormat, c.idname, c.feature, gRegions, geneIds, pCoding)) return 1;
+
+    // End
+    now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Done." << std::endl;
+    return 0;
+  }
+
+
+  int featureindex(int argc, char** argv) {
+    FeatureConfig c;
+    boost::filesystem::path outfile;
+
+    // Parameter
+    boost::program_options::options_description generic("Generic options");
+    generic.add_options()
+      ("help,?", "show help message")
+      ("gtf,g", boost::program_options::value<boost::filesystem::path>(&c.gtfFile), "gtf/gff3/bed file")
+      ("id,i", boost::program_options::value<std::string>(&c.idname)->default_value("gene_name"), "gtf/gff3 attribute")
+      ("feature,f", boost::program_options::value<std::string>(&c.feature)->default_value("gene"), "gtf/gff3 feature")
+      ("output,o", boost::program_options::value<boost::filesystem::path>(&outfile)->default_value("features.sfi"), "output binary feature index")
+      ;
+
+    boost::program_options::options_description cmdline_options;
+    cmdline_options.add(generic);
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(cmdline_options).run(), vm);
+    boost::program_options::notify(vm);
+
+    // Check command line arguments
+    if ((vm.count("help")) || (!vm.count("gtf"))) {
+      std::cerr << std::endl;
+      std::cerr << "Usage: sansa " << argv[0] << " [OPTIONS] -g genes.gtf.gz" << std::endl;
+      std::cerr << generic << "\n";
+      return -1;
+    }
+
+    // Check input file
+    if (!(boost::filesystem::exists(c.gtfFile) && boost::filesystem::is_regular_file(c.gtfFile) && boost::filesystem::file_size(c.gtfFile))) {
+      std::cerr << "Input GTF/GFF3/BED file is missing: " << c.gtfFile.string() << std::endl;
+      return 1;
+    }
+    if (is_featuredb(c.gtfFile)) {
+      std::cerr << "Input file is already a feature index: " << c.gtfFile.string() << std::endl;
+      return 1;
+    }
+    c.gtfFileFormat = _featureFileFormat(c.gtfFile);
+    if (c.feature.find(',') != std::string::npos) {
+      std::cerr << "A feature index holds a single feature type, please build one index per feature type." << std::endl;
+      return 1;
+    }
+
+    // Check output directory
+    if (!_outfileValid(outfile)) return 1;
+
+    // Show cmd
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] ";
+    std::cerr << "sansa ";
+    for(int i=0; i<argc; ++i) { std::cerr << argv[i] << ' '; }
+    std::cerr << std::endl;
+
+    return runFeatureIndex(c, outfile);
+  }
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef FEATUREREADER_H
+#define FEATUREREADER_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <htslib/hts.h>
+#include <htslib/tbx.h>
+#include <htslib/kstring.h>
+
+#include "util.h"
+
+namespace sansa
+{
+
+  inline bool
+  is_tabixed(boost::filesystem::path const& f) {
+    return ((boost::filesystem::exists(f.string() + ".tbi")) || (boost::filesystem::exists(f.string() + ".csi")));
+  }
+
+  // Lines of a gzipped GTF/GFF3/BED file
+  // A BGZF file with a tabix index is only read on the chromosomes flagged in c.queryChr, otherwise the whole file is streamed
+  struct FeatureLineReader {
+    std::ifstream file;
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
+    std::unique_ptr<std::istream> instream;
+    std::string gline;
+    htsFile* hfile;
+    tbx_t* tbx;
+    hts_itr_t* itr;
+    kstring_t str;
+    std::vector<int32_t> tids;   // Tabix contigs to fetch
+    uint32_t tidx;
+    uint64_t bytes;
+
+    FeatureLineReader() : hfile(NULL), tbx(NULL), itr(NULL), tidx(0), bytes(0) {
+      str.l = 0;
+      str.m = 0;
+      str.s = NULL;
+    }
+
+    ~FeatureLineReader() {
+      if (itr != NULL) hts_itr_destroy(itr);
+      if (tbx != NULL) tbx_destroy(tbx);
+      if (hfile != NULL) hts_close(hfile);
+      if (str.s != NULL) free(str.s);
+    }
+
+    template<typename TConfig>
+    bool open(TConfig const& c) {
+      if (!c.queryChr.empty()) {
+	tbx = tbx_index_load3(c.gtfFile.string().c_str(), NULL, HTS_IDX_SILENT_FAIL);
+	if (tbx != NULL) {
+	  hfile = hts_open(c.gtfFile.string().c_str(), "r");
+	  if (hfile == NULL) {
+	    std::cerr << "Fail to load " << c.gtfFile.string() << std::endl;
+	    return false;
+	  }
+	  int32_t nseq = 0;
+	  const char** seqnames = tbx_seqnames(tbx, &nseq);
+	  for(int32_t tid = 0; tid < nseq; ++tid) {
+	    typename TConfig::TChrMap::const_iterator itcm = c.nchr.find(std::string(seqnames[tid]));
+	    if ((itcm != c.nchr.end()) && (itcm->second < (int32_t) c.queryChr.size()) && (c.queryChr[itcm->second])) tids.push_back(tid);
+	  }
+	  if (seqnames != NULL) free(seqnames);
+	  boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+	  std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Fetch " << tids.size() << " out of " << nseq << " indexed feature file chromosomes" << std::endl;
+	  return true;
+	}
+      }
+      file.open(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
+      dataIn.push(boost::iostreams::gzip_decompressor());
+      dataIn.push(file);
+      instream.reset(new std::istream(&dataIn));
+      return true;
+    }
+
+    bool next(std::string_view& line) {
+      if (tbx != NULL) {
+	while (true) {
+	  if (itr == NULL) {
+	    if (tidx >= tids.size()) return false;
+	    itr = tbx_itr_queryi(tbx, tids[tidx++], 0, HTS_POS_MAX);
+	    if (itr == NULL) continue;
+	  }
+	  if (tbx_itr_next(hfile, tbx, itr, &str) >= 0) {
+	    bytes += str.l + 1;
+	    line = std::string_view(str.s, str.l);
+	    return true;
+	  }
+	  hts_itr_destroy(itr);
+	  itr = NULL;
+	}
+      }
+      if (!std::getline(*instream, gline)) return false;
+      bytes += gline.size() + 1;
+      line = gline;
+      return true;
+    }
+
+  private:
+    FeatureLineReader(FeatureLineReader const&);
+    FeatureLineReader& operator=(FeatureLineReader const&);
+  };
+
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef FIELDPARSER_H
+#define FIELDPARSER_H
+
+#include <cctype>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace sansa
+{
+
+  // Next token of a line, runs of separators are skipped like boost::char_separator
+  inline bool
+  _nextToken(std::string_view& line, std::string_view const seps, std::string_view& tok) {
+    std::string_view::size_type s = line.find_first_not_of(seps);
+    if (s == std::string_view::npos) {
+      line = std::string_view();
+      return false;
+    }
+    std::string_view::size_type e = line.find_first_of(seps, s);
+    if (e == std::string_view::npos) {
+      tok = line.substr(s);
+      line = std::string_view();
+    } else {
+      tok = line.substr(s, e - s);
+      line.remove_prefix(e + 1);
+    }
+    return true;
+  }
+
+  inline std::string_view
+  _trimToken(std::string_view tok) {
+    while ((!tok.empty()) && (std::isspace((unsigned char) tok.front()))) tok.remove_prefix(1);
+    while ((!tok.empty()) && (std::isspace((unsigned char) tok.back()))) tok.remove_suffix(1);
+    return tok;
+  }
+
+  inline bool
+  _parseInt32(std::string_view const tok, int32_t& val) {
+    std::from_chars_result res = std::from_chars(tok.data(), tok.data() + tok.size(), val);
+    return ((res.ec == std::errc()) && (res.ptr == tok.data() + tok.size()));
+  }
+
+  // Splits an attribute into key and value, e.g. gene_name "TP53" or Name=TP53
+  inline bool
+  _splitAttribute(std::string_view keyval, char const sep, std::string_view& key, std::string_view& val) {
+    keyval = _trimToken(keyval);
+    std::string_view seps(&sep, 1);
+    if (!_nextToken(keyval, seps, key)) return false;
+    return _nextToken(keyval, seps, val);
+  }
+
+  // Position of a feature type in the requested feature types, -1 if not requested
+  inline int32_t
+  _featureTypeIndex(std::vector<std::string> const& features, std::string_view const ft) {
+    for(uint32_t k = 0; k < features.size(); ++k) {
+      if (ft == features[k]) return k;
+    }
+    return -1;
+  }
+
+  // Hash-based interner of feature ids, ids are assigned in order of first occurrence
+  struct FeatureIdInterner {
+    typedef boost::unordered_map<std::string, int32_t> TIdMap;
+    TIdMap idMap;
+    std::string key;
+
+    // True if val is a new id
+    template<typename TGeneIds>
+    bool intern(std::string_view const val, TGeneIds& geneIds, int32_t& idval) {
+      key.assign(val.data(), val.size());
+      TIdMap::const_iterator it = idMap.find(key);
+      if (it != idMap.end()) {
+	idval = it->second;
+	return false;
+      }
+      idval = geneIds.size();
+      idMap.insert(std::make_pair(key, idval));
+      geneIds.push_back(key);
+      return true;
+    }
+
+    // True if val is a new id, ids are consecutive from 0
+    bool intern(std::string_view const val, int32_t& idval) {
+      key.assign(val.data(), val.size());
+      std::pair<TIdMap::iterator, bool> res = idMap.insert(std::make_pair(key, (int32_t) idMap.size()));
+      idval = res.first->second;
+      return res.second;
+    }
+  };
+
+  // Chromosome id of a feature line, the previous lookup is reused for sorted files
+  template<typename TChrMap>
+  struct ChrNameCache {
+    TChrMap const& nchr;
+    std::string lastName;
+    int32_t lastId;
+
+    explicit ChrNameCache(TChrMap const& n) : nchr(n), lastId(-1) {}
+
+    int32_t find(std::string_view const chrName) {
+      if (chrName != lastName) {
+	lastName.assign(chrName.data(), chrName.size());
+	typename TChrMap::const_iterator itcm = nchr.find(lastName);
+	if (itcm == nchr.end()) lastId = -1;
+	else lastId = itcm->second;
+      }
+      return lastId;
+    }
+  };
+
+  // Feature file parsing throughput
+  inline void
+  _parseRate(char const* format, uint64_t const bytes, boost::posix_time::ptime const& start) {
+    double sec = (boost::posix_time::microsec_clock::local_time() - start).total_microseconds() / 1000000.0;
+    double mb = bytes / 1048576.0;
+    std::cerr << '[' << boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()) << "] Parsed " << (uint64_t) mb << "MB of " << format << " in " << sec << "s (" << (uint64_t) ((sec > 0) ? mb / sec : 0) << " MB/s)" << std::endl;
+  }
+
+}
+
+#endif
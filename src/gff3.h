@@ -14,100 +14,111 @@
 #include <htslib/sam.h>
 
 #include "util.h"
+#include "fieldparser.h"
+#include "featurereader.h"
 
 namespace sansa
 {
 
-  template<typename TConfig, typename TParentIdMap>
+  // ID, Parent, id attribute and protein-coding biotype of a GFF3 attribute column
   inline void
-  _buildIDdict(TConfig const& c, TParentIdMap& pId) {
-    TParentIdMap tree;
-    std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
-    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
-    dataIn.push(boost::iostreams::gzip_decompressor());
-    dataIn.push(file);
-    std::istream instream(&dataIn);
-    std::string gline;
-    while(std::getline(instream, gline)) {
-      if ((gline.size()) && (gline[0] == '#')) continue;
-      typedef boost::tokenizer< boost::char_separator<char> > Tokenizer;
-      boost::char_separator<char> sep("\t");
-      Tokenizer tokens(gline, sep);
-      Tokenizer::iterator tokIter = tokens.begin();
-      uint32_t idx = 0;
-      for(;tokIter!=tokens.end();++tokIter) ++idx;
-      if (idx >= 9) {
-	std::string attr = *tokIter;
-	std::size_t found = attr.find(c.idname);
-	if (found != std::string::npos) {
-	  bool pCode = false;
-	  std::string kval = "";
-	  std::string ival = "";
-	  boost::char_separator<char> sepAttr(";");
-	  Tokenizer attrTokens(attr, sepAttr);
-	  for(Tokenizer::iterator attrIter = attrTokens.begin(); attrIter != attrTokens.end(); ++attrIter) {
-	    std::string keyval = *attrIter;
-	    boost::trim(keyval);
-	    boost::char_separator<char> sepKeyVal("=");
-	    Tokenizer kvTokens(keyval, sepKeyVal);
-	    Tokenizer::iterator kvTokensIt = kvTokens.begin();
-	    std::string key = *kvTokensIt++;
-	    if (key == "ID") ival = *kvTokensIt;
-	    else if (key == c.idname) kval = *kvTokensIt;
-	    else if (key == "biotype") {
-	      if (*kvTokensIt == "protein_coding") pCode = true;
-	    }
-	  }
-	  if (ival.empty()) ival = kval;
-	  pId[ival] = std::make_pair(kval, pCode);
+  _parseGFF3Attributes(std::string_view attr, std::string const& idname, std::string_view& ival, std::string_view& pval, std::string_view& kval, bool& pCode) {
+    std::string_view kv;
+    while(_nextToken(attr, ";", kv)) {
+      std::string_view key;
+      std::string_view val;
+      if (!_splitAttribute(kv, '=', key, val)) continue;
+      if (key == "ID") ival = val;
+      if (key == "Parent") pval = val;
+      if (key == idname) kval = val;
+      if ((key == "biotype") && (val == "protein_coding")) pCode = true;
+    }
+  }
+
+  // ID hierarchy of a GFF3 file, nodes are interned ID, Parent and id attribute values
+  struct GFF3Hierarchy {
+    FeatureIdInterner nodeIds;
+    std::vector<int32_t> parent;   // Parent node, -1 if none
+    std::vector<int32_t> gene;     // Gene record of a node, -1 if none
+    std::vector<int32_t> top;      // Topmost ancestor with a gene record, -1 if none
+    std::vector<std::string> geneNames;
+    std::vector<bool> geneCoding;
+
+    int32_t node(std::string_view const val) {
+      int32_t n;
+      if (nodeIds.intern(val, n)) {
+	parent.push_back(-1);
+	gene.push_back(-1);
+      }
+      return n;
+    }
+
+    void setGene(std::string_view const id, std::string_view const name, bool const pCode) {
+      int32_t n = node(id);
+      if (gene[n] == -1) {
+	gene[n] = geneNames.size();
+	geneNames.push_back(std::string());
+	geneCoding.push_back(false);
+      }
+      geneNames[gene[n]].assign(name.data(), name.size());
+      geneCoding[gene[n]] = pCode;
+    }
+
+    void setParent(std::string_view const id, std::string_view const p) {
+      int32_t n = node(id);
+      parent[n] = node(p);
+    }
+
+    // Iterative, path-compressed lookup of the topmost ancestor with a gene record for every node
+    // Cycles in the Parent graph are cut where they close
+    void resolve() {
+      top.assign(parent.size(), -2);
+      std::vector<int32_t> path;
+      for(uint32_t n = 0; n < parent.size(); ++n) {
+	if (top[n] != -2) continue;
+	path.clear();
+	int32_t x = n;
+	while ((x != -1) && (top[x] == -2)) {
+	  top[x] = -3;   // On the current path
+	  path.push_back(x);
+	  x = parent[x];
 	}
-	// Make sure we also find grand-children
-	found = attr.find("Parent");
-	if (found != std::string::npos) {
-	  bool pCode = false;
-	  std::string pval = "";
-	  std::string ival = "";
-	  boost::char_separator<char> sepAttr(";");
-	  Tokenizer attrTokens(attr, sepAttr);
-	  for(Tokenizer::iterator attrIter = attrTokens.begin(); attrIter != attrTokens.end(); ++attrIter) {
-	    std::string keyval = *attrIter;
-	    boost::trim(keyval);
-	    boost::char_separator<char> sepKeyVal("=");
-	    Tokenizer kvTokens(keyval, sepKeyVal);
-	    Tokenizer::iterator kvTokensIt = kvTokens.begin();
-	    std::string key = *kvTokensIt++;
-	    if (key == "ID") ival = *kvTokensIt;
-	    else if (key == "Parent") pval = *kvTokensIt;
-	    else if (key == "biotype") {
-	      if (*kvTokensIt == "protein_coding") pCode = true;
-	    }
-	  }
-	  tree[ival] = std::make_pair(pval, pCode);
+	for(int32_t i = path.size() - 1; i >= 0; --i) {
+	  int32_t p = parent[path[i]];
+	  top[path[i]] = -1;
+	  if (p == -1) continue;
+	  if (top[p] >= 0) top[path[i]] = top[p];
+	  else if (gene[p] != -1) top[path[i]] = p;
 	}
       }
     }
-    file.close();
 
-    // Now flatten the parent-child hierarchy
-    if (!tree.empty()) {
-      for(typename TParentIdMap::iterator pit = tree.begin(); pit!= tree.end(); ++pit) {
-	std::string newParent = pit->second.first;
-	bool carryOn = true;
-	do {
-	  if (pId.find(newParent) != pId.end()) pId[pit->first] = pId[newParent];
-	  if (tree.find(newParent) == tree.end()) carryOn = false;
-	  else newParent = tree.find(newParent)->second.first;
-	} while (carryOn);
-      }
+    // Gene record of a feature ID, ancestors take precedence, -1 if none
+    int32_t geneOf(int32_t const n) const {
+      if (top[n] != -1) return gene[top[n]];
+      return gene[n];
     }
-  }
+  };
+
+  // Feature line of the requested type, resolved once the whole hierarchy is known
+  struct GFF3Candidate {
+    int32_t chrid;
+    int32_t start;
+    int32_t end;
+    char strand;
+    int32_t fidx;   // Feature type
+    uint32_t first;   // Node range in the candidate node list
+    uint32_t last;
+  };
 
 
+  // Features of several types in one pass, the ID hierarchy is shared and features[k] goes to overlappingRegions[k], geneIds[k] and pCoding[k]
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
   inline int32_t
-  parseGFF3All(TConfig const& c, TGenomicRegions& overlappingRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+  parseGFF3All(TConfig const& c, std::vector<std::string> const& features, std::vector<TGenomicRegions>& overlappingRegions, std::vector<TGeneIds>& geneIds, std::vector<TProteinCoding>& pCoding) {
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] " << "GFF3 feature parsing" << std::endl;
+    boost::posix_time::ptime parseStart = boost::posix_time::microsec_clock::local_time();
     
     // Check gzip
     if (!is_gz(c.gtfFile)) {
@@ -115,104 +126,132 @@ namespace sansa
       return 0;
     }
 
-    // ID dictionary
-    typedef std::pair<std::string, bool> TGeneProteinCoding;
-    typedef std::map<std::string, TGeneProteinCoding> TParentIdMap;
-    TParentIdMap pId;
-    _buildIDdict(c, pId);
-
-    // Map IDs to integer
-    typedef std::map<std::string, int32_t> TIdMap;
-    TIdMap idMap;
-
-    // Keep track of unique exon IDs
-    int32_t eid = 0;
+    // ID hierarchy and candidate features, collected in a single pass
+    GFF3Hierarchy hier;
+    std::vector<GFF3Candidate> cands;
+    std::vector<int32_t> candNodes;
+    ChrNameCache<typename TConfig::TChrMap> chrCache(c.nchr);
 
     // Parse GFF3
-    std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
-    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
-    dataIn.push(boost::iostreams::gzip_decompressor());
-    dataIn.push(file);
-    std::istream instream(&dataIn);
-    std::string gline;
-    while(std::getline(instream, gline)) {
+    FeatureLineReader reader;
+    if (!reader.open(c)) return 0;
+    std::string_view gline;
+    while(reader.next(gline)) {
       if ((gline.size()) && (gline[0] == '#')) continue;
-      typedef boost::tokenizer< boost::char_separator<char> > Tokenizer;
-      boost::char_separator<char> sep("\t");
-      Tokenizer tokens(gline, sep);
-      Tokenizer::iterator tokIter = tokens.begin();
-      if (tokIter==tokens.end()) {
+      std::string_view line(gline);
+      std::string_view fields[9];
+      std::string_view attr;
+      uint32_t nfields = 0;
+      std::string_view tok;
+      while(_nextToken(line, "\t", tok)) {
+	if (nfields < 9) fields[nfields] = tok;
+	attr = tok;
+	++nfields;
+      }
+      if (nfields == 0) {
 	std::cerr << "Empty line in GFF3 file!" << std::endl;
 	return 0;
       }
-      std::string chrName=*tokIter++;
-      if (c.nchr.find(chrName) == c.nchr.end()) continue;
-      int32_t chrid = c.nchr.find(chrName)->second;
-      if (tokIter == tokens.end()) {
+
+      // ID hierarchy
+      if (nfields >= 9) {
+	bool hasId = (attr.find(c.idname) != std::string_view::npos);
+	// Make sure we also find grand-children
+	bool hasParent = (attr.find("Parent") != std::string_view::npos);
+	if ((hasId) || (hasParent)) {
+	  std::string_view ival;
+	  std::string_view pval;
+	  std::string_view kval;
+	  bool pCode = false;
+	  _parseGFF3Attributes(attr, c.idname, ival, pval, kval, pCode);
+	  if (hasId) hier.setGene(ival.empty() ? kval : ival, kval, pCode);
+	  if (hasParent) hier.setParent(ival, pval);
+	}
+      }
+
+      // Candidate features
+      int32_t chrid = chrCache.find(fields[0]);
+      if (chrid == -1) continue;
+      if (nfields < 3) {
 	std::cerr << "Corrupted GFF3 file!" << std::endl;
 	return 0;
       }
-      ++tokIter;
-      if (tokIter == tokens.end()) {
+      int32_t fidx = _featureTypeIndex(features, fields[2]);
+      if (fidx == -1) continue;
+      if (nfields == 3) continue;
+      GFF3Candidate cand;
+      cand.chrid = chrid;
+      cand.fidx = fidx;
+      if ((nfields < 9) || (!_parseInt32(fields[3], cand.start)) || (!_parseInt32(fields[4], cand.end)) || (fields[6].size() != 1)) {
 	std::cerr << "Corrupted GFF3 file!" << std::endl;
 	return 0;
       }
-      std::string ft = *tokIter++;
-      if (ft == c.feature) {
-	if (tokIter != tokens.end()) {
-	  int32_t start = boost::lexical_cast<int32_t>(*tokIter++);
-	  int32_t end = boost::lexical_cast<int32_t>(*tokIter++);
-	  ++tokIter; // score
-	  if (tokIter == tokens.end()) {
-	    std::cerr << "Corrupted GFF3 file!" << std::endl;
-	    return 0;
-	  }
-	  char strand = boost::lexical_cast<char>(*tokIter++);
-	  ++tokIter; // frame or phase
-	  std::string attr = *tokIter;
-	  boost::char_separator<char> sepAttr(";");
-	  Tokenizer attrTokens(attr, sepAttr);
-	  for(Tokenizer::iterator attrIter = attrTokens.begin(); attrIter != attrTokens.end(); ++attrIter) {
-	    std::string keyval = *attrIter;
-	    boost::trim(keyval);
-	    boost::char_separator<char> sepKeyVal("=");
-	    Tokenizer kvTokens(keyval, sepKeyVal);
-	    Tokenizer::iterator kvTokensIt = kvTokens.begin();
-	    std::string key = *kvTokensIt++;
-	    if ((key == "ID") || (key == "Parent") || (key == c.idname)) {
-	      std::string ivl = *kvTokensIt;
-	      if (pId.find(ivl) != pId.end()) {
-		std::string val = pId[ivl].first;
-		bool pCode = pId[ivl].second;
-		int32_t idval = geneIds.size();
-		typename TIdMap::const_iterator idIter = idMap.find(val);
-		if (idIter == idMap.end()) {
-		  idMap.insert(std::make_pair(val, idval));
-		  geneIds.push_back(val);
-		  pCoding.push_back(pCode);
-		} else idval = idIter->second;
-		// Convert to 0-based and right-open
-		if (start == 0) {
-		  std::cerr << "GFF3 is 1-based format!" << std::endl;
-		  return 0;
-		}
-		if (start > end) {
-		  std::cerr << "Feature start is greater than feature end!" << std::endl;
-		  return 0;
-		}
-		//std::cerr << geneIds[idval] << "\t" << start << "\t" << end << "\t(" << idval << "," << eid << ")" << std::endl;
-		_insertInterval(overlappingRegions[chrid], start - 1, end, strand, idval, eid++);
-	      }
-	    }
-	  }
+      cand.strand = fields[6][0];
+      cand.first = candNodes.size();
+      std::string_view fattr = fields[8];
+      std::string_view kv;
+      while(_nextToken(fattr, ";", kv)) {
+	std::string_view key;
+	std::string_view val;
+	if (!_splitAttribute(kv, '=', key, val)) continue;
+	if ((key == "ID") || (key == "Parent") || (key == c.idname)) candNodes.push_back(hier.node(val));
+      }
+      cand.last = candNodes.size();
+      if (cand.last > cand.first) cands.push_back(cand);
+    }
+    _parseRate("GFF3", reader.bytes, parseStart);
+
+    // Resolve the hierarchy, a candidate may reference IDs defined further down the file
+    hier.resolve();
+    std::vector<FeatureIdInterner> idMap(features.size());
+
+    // Keep track of unique exon IDs
+    std::vector<int32_t> eid(features.size(), 0);
+    for(uint32_t i = 0; i < cands.size(); ++i) {
+      int32_t fidx = cands[i].fidx;
+      for(uint32_t k = cands[i].first; k < cands[i].last; ++k) {
+	int32_t g = hier.geneOf(candNodes[k]);
+	if (g == -1) continue;
+	int32_t idval;
+	if (idMap[fidx].intern(hier.geneNames[g], geneIds[fidx], idval)) pCoding[fidx].push_back(hier.geneCoding[g]);
+	// Convert to 0-based and right-open
+	if (cands[i].start == 0) {
+	  std::cerr << "GFF3 is 1-based format!" << std::endl;
+	  return 0;
 	}
+	if (cands[i].start > cands[i].end) {
+	  std::cerr << "Feature start is greater than feature end!" << std::endl;
+	  return 0;
+	}
+	_insertInterval(overlappingRegions[fidx][cands[i].chrid], cands[i].start - 1, cands[i].end, cands[i].strand, idval, eid[fidx]++);
       }
     }
-    if (geneIds.empty()) {
-      std::cerr << "No elements found with " << c.feature << "!" << std::endl;
-      std::cerr << "Are you specifying a feature present in the gff file?" << std::endl;
+    int32_t nids = 0;
+    for(uint32_t k = 0; k < features.size(); ++k) {
+      if (geneIds[k].empty()) {
+	std::cerr << "No elements found with " << features[k] << "!" << std::endl;
+	std::cerr << "Are you specifying a feature present in the gff file?" << std::endl;
+      }
+      nids += geneIds[k].size();
     }
-    return geneIds.size();
+    return nids;
+  }
+
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
+  inline int32_t
+  parseGFF3All(TConfig const& c, TGenomicRegions& overlappingRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+    std::vector<std::string> features(1, c.feature);
+    std::vector<TGenomicRegions> regions(1);
+    std::vector<TGeneIds> ids(1);
+    std::vector<TProteinCoding> coding(1);
+    regions[0].swap(overlappingRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    int32_t nids = parseGFF3All(c, features, regions, ids, coding);
+    regions[0].swap(overlappingRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    return nids;
   }
 
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds>
@@ -225,40 +264,38 @@ namespace sansa
 
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
   inline int32_t
-  parseGFF3(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+  parseGFF3(TConfig const& c, std::vector<std::string> const& features, std::vector<TGenomicRegions>& gRegions, std::vector<TGeneIds>& geneIds, std::vector<TProteinCoding>& pCoding) {
     typedef typename TGenomicRegions::value_type TChromosomeRegions;
 
     // Overlapping intervals for each label
-    TGenomicRegions overlappingRegions;
-    overlappingRegions.resize(gRegions.size(), TChromosomeRegions());
-    parseGFF3All(c, overlappingRegions, geneIds, pCoding);
+    std::vector<TGenomicRegions> overlappingRegions(features.size());
+    for(uint32_t k = 0; k < features.size(); ++k) overlappingRegions[k].resize(gRegions[k].size(), TChromosomeRegions());
+    int32_t nids = parseGFF3All(c, features, overlappingRegions, geneIds, pCoding);
 
     // Make intervals non-overlapping for each label
-    for(uint32_t refIndex = 0; refIndex < overlappingRegions.size(); ++refIndex) {
-      // Sort by ID
-      std::sort(overlappingRegions[refIndex].begin(), overlappingRegions[refIndex].end(), SortIntervalLabel<IntervalLabel>());
-      int32_t runningId = -1;
-      char runningStrand = '*';
-      typedef boost::icl::interval_set<uint32_t> TIdIntervals;
-      typedef typename TIdIntervals::interval_type TIVal;
-      TIdIntervals idIntervals;
-      for(uint32_t i = 0; i < overlappingRegions[refIndex].size(); ++i) {
-	if (overlappingRegions[refIndex][i].lid != runningId) {
-	  for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) {
-	    //std::cerr << "merged\t" << geneIds[runningId] << "\t" << it->lower() << "\t" << it->upper() << std::endl;  
-	    gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
-	  }
-	  idIntervals.clear();
-	  runningId = overlappingRegions[refIndex][i].lid;
-	  runningStrand = overlappingRegions[refIndex][i].strand;
-	}
-	idIntervals.insert(TIVal::right_open(overlappingRegions[refIndex][i].start, overlappingRegions[refIndex][i].end));
+    for(uint32_t k = 0; k < features.size(); ++k) {
+      for(uint32_t refIndex = 0; refIndex < overlappingRegions[k].size(); ++refIndex) {
+	_mergeLabelIntervals(overlappingRegions[k][refIndex], gRegions[k][refIndex]);
       }
-      // Process last id
-      for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
     }
-    
-    return geneIds.size();
+    return nids;
+  }
+
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
+  inline int32_t
+  parseGFF3(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+    std::vector<std::string> features(1, c.feature);
+    std::vector<TGenomicRegions> regions(1);
+    std::vector<TGeneIds> ids(1);
+    std::vector<TProteinCoding> coding(1);
+    regions[0].swap(gRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    int32_t nids = parseGFF3(c, features, regions, ids, coding);
+    regions[0].swap(gRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    return nids;
   }
 
 
@@ -14,15 +14,19 @@
 #include <htslib/sam.h>
 
 #include "util.h"
+#include "fieldparser.h"
+#include "featurereader.h"
 
 namespace sansa
 {
 
+  // Features of several types in one pass, lines of features[k] go to overlappingRegions[k], geneIds[k] and pCoding[k]
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
   inline int32_t
-  parseGTFAll(TConfig const& c, TGenomicRegions& overlappingRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+  parseGTFAll(TConfig const& c, std::vector<std::string> const& features, std::vector<TGenomicRegions>& overlappingRegions, std::vector<TGeneIds>& geneIds, std::vector<TProteinCoding>& pCoding) {
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] " << "GTF feature parsing" << std::endl;
+    boost::posix_time::ptime parseStart = boost::posix_time::microsec_clock::local_time();
 
     // Check gzip
     if (!is_gz(c.gtfFile)) {
@@ -30,106 +34,94 @@ namespace sansa
       return 0;
     }
 
-    // Map IDs to integer
-    typedef std::map<std::string, int32_t> TIdMap;
-    TIdMap idMap;
+    // Map IDs to integer, separately for each feature type
+    std::vector<FeatureIdInterner> idMap(features.size());
+    ChrNameCache<typename TConfig::TChrMap> chrCache(c.nchr);
 
     // Keep track of unique exon IDs
-    int32_t eid = 0;
+    std::vector<int32_t> eid(features.size(), 0);
 
     // Parse GTF
-    std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
-    boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
-    dataIn.push(boost::iostreams::gzip_decompressor());
-    dataIn.push(file);
-    std::istream instream(&dataIn);
-    std::string gline;
-    while(std::getline(instream, gline)) {
+    FeatureLineReader reader;
+    if (!reader.open(c)) return 0;
+    std::string_view gline;
+    while(reader.next(gline)) {
       if ((gline.size()) && (gline[0] == '#')) continue;
-      typedef boost::tokenizer< boost::char_separator<char> > Tokenizer;
-      boost::char_separator<char> sep("\t");
-      Tokenizer tokens(gline, sep);
-      Tokenizer::iterator tokIter = tokens.begin();
-      if (tokIter==tokens.end()) {
+      std::string_view line(gline);
+      std::string_view tok;
+      if (!_nextToken(line, "\t", tok)) {
 	std::cerr << "Empty line in GTF file!" << std::endl;
 	return 0;
       }
-      std::string chrName=*tokIter++;
-      if (c.nchr.find(chrName) == c.nchr.end()) continue;
-      int32_t chrid = c.nchr.find(chrName)->second;      
-      if (tokIter == tokens.end()) {
+      int32_t chrid = chrCache.find(tok);
+      if (chrid == -1) continue;
+      std::string_view ft;
+      if ((!_nextToken(line, "\t", tok)) || (!_nextToken(line, "\t", ft))) {
 	std::cerr << "Corrupted GTF file!" << std::endl;
 	return 0;
       }
-      ++tokIter;
-      if (tokIter == tokens.end()) {
+      int32_t fidx = _featureTypeIndex(features, ft);
+      if (fidx == -1) continue;
+      if (line.empty()) continue;
+      int32_t start = 0;
+      int32_t end = 0;
+      std::string_view strand;
+      std::string_view attr;
+      if ((!_nextToken(line, "\t", tok)) || (!_parseInt32(tok, start)) || (!_nextToken(line, "\t", tok)) || (!_parseInt32(tok, end)) || (!_nextToken(line, "\t", tok)) || (!_nextToken(line, "\t", strand)) || (strand.size() != 1) || (!_nextToken(line, "\t", tok)) || (!_nextToken(line, "\t", attr))) {
 	std::cerr << "Corrupted GTF file!" << std::endl;
 	return 0;
       }
-      std::string ft = *tokIter++;
-      if (ft == c.feature) {
-	if (tokIter != tokens.end()) {
-	  int32_t start = boost::lexical_cast<int32_t>(*tokIter++);
-	  int32_t end = boost::lexical_cast<int32_t>(*tokIter++);
-	  ++tokIter; // score
-	  if (tokIter == tokens.end()) {
-	    std::cerr << "Corrupted GTF file!" << std::endl;
-	    return 0;
-	  }
-	  char strand = boost::lexical_cast<char>(*tokIter++);
-	  ++tokIter; // frame
-	  std::string attr = *tokIter;
-	  boost::char_separator<char> sepAttr(";");
-	  Tokenizer attrTokens(attr, sepAttr);
-	  for(Tokenizer::iterator attrIter = attrTokens.begin(); attrIter != attrTokens.end(); ++attrIter) {
-	    std::string keyval = *attrIter;
-	    boost::trim(keyval);
-	    boost::char_separator<char> sepKeyVal(" ");
-	    Tokenizer kvTokens(keyval, sepKeyVal);
-	    Tokenizer::iterator kvTokensIt = kvTokens.begin();
-	    std::string key = *kvTokensIt++;
-	    if (key == c.idname) {
-	      std::string val = *kvTokensIt;
-	      if (val.size() >= 3) val = val.substr(1, val.size()-2); // Trim off the bloody "
-	      int32_t idval = geneIds.size();
-	      typename TIdMap::const_iterator idIter = idMap.find(val);
-	      if (idIter == idMap.end()) {
-		idMap.insert(std::make_pair(val, idval));
-		geneIds.push_back(val);
-		// Protein Coding?
-		bool pCode = false;
-		for(Tokenizer::iterator arIter = attrTokens.begin(); arIter != attrTokens.end(); ++arIter) {
-		  std::string kvl = *arIter;
-		  boost::trim(kvl);
-		  boost::char_separator<char> sKV2(" ");
-		  Tokenizer kvT2(kvl, sKV2);
-		  Tokenizer::iterator kvT2It = kvT2.begin();
-		  std::string procod = *kvT2It++;
-		  if (procod == "gene_biotype") {
-		    std::string gbio = *kvT2It;
-		    if (gbio.size() >= 3) gbio = gbio.substr(1, gbio.size()-2);
-		    if (gbio == "protein_coding") pCode = true;
-		  }
-		}
-		pCoding.push_back(pCode);
-	      } else idval = idIter->second;
-	      // Convert to 0-based and right-open
-	      if (start == 0) {
-		std::cerr << "GTF is 1-based format!" << std::endl;
-		return 0;
-	      }
-	      if (start > end) {
-		std::cerr << "Feature start is greater than feature end!" << std::endl;
-		return 0;
-	      }
-	      //std::cerr << geneIds[idval] << "\t" << start << "\t" << end << std::endl;
-	      _insertInterval(overlappingRegions[chrid], start - 1, end, strand, idval, eid++);
-	    }
-	  }
-	}
+
+      // Single pass over the attributes for the feature id and its biotype
+      std::string_view val;
+      bool hasId = false;
+      bool pCode = false;
+      std::string_view kv;
+      while(_nextToken(attr, ";", kv)) {
+	std::string_view key;
+	std::string_view kval;
+	if (!_splitAttribute(kv, ' ', key, kval)) continue;
+	if (kval.size() >= 3) kval = kval.substr(1, kval.size() - 2); // Trim off the bloody "
+	if ((!hasId) && (key == c.idname)) {
+	  val = kval;
+	  hasId = true;
+	} else if ((key == "gene_biotype") && (kval == "protein_coding")) pCode = true;
       }
+      if (!hasId) continue;
+      int32_t idval;
+      if (idMap[fidx].intern(val, geneIds[fidx], idval)) pCoding[fidx].push_back(pCode);
+      // Convert to 0-based and right-open
+      if (start == 0) {
+	std::cerr << "GTF is 1-based format!" << std::endl;
+	return 0;
+      }
+      if (start > end) {
+	std::cerr << "Feature start is greater than feature end!" << std::endl;
+	return 0;
+      }
+      _insertInterval(overlappingRegions[fidx][chrid], start - 1, end, strand[0], idval, eid[fidx]++);
     }
-    return geneIds.size();
+    _parseRate("GTF", reader.bytes, parseStart);
+    int32_t nids = 0;
+    for(uint32_t k = 0; k < geneIds.size(); ++k) nids += geneIds[k].size();
+    return nids;
+  }
+
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
+  inline int32_t
+  parseGTFAll(TConfig const& c, TGenomicRegions& overlappingRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+    std::vector<std::string> features(1, c.feature);
+    std::vector<TGenomicRegions> regions(1);
+    std::vector<TGeneIds> ids(1);
+    std::vector<TProteinCoding> coding(1);
+    regions[0].swap(overlappingRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    int32_t nids = parseGTFAll(c, features, regions, ids, coding);
+    regions[0].swap(overlappingRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    return nids;
   }
 
 
@@ -142,40 +134,38 @@ namespace sansa
   
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
   inline int32_t
-  parseGTF(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+  parseGTF(TConfig const& c, std::vector<std::string> const& features, std::vector<TGenomicRegions>& gRegions, std::vector<TGeneIds>& geneIds, std::vector<TProteinCoding>& pCoding) {
     typedef typename TGenomicRegions::value_type TChromosomeRegions;
 
     // Overlapping intervals for each label
-    TGenomicRegions overlappingRegions;
-    overlappingRegions.resize(gRegions.size(), TChromosomeRegions());
-    parseGTFAll(c, overlappingRegions, geneIds, pCoding);
+    std::vector<TGenomicRegions> overlappingRegions(features.size());
+    for(uint32_t k = 0; k < features.size(); ++k) overlappingRegions[k].resize(gRegions[k].size(), TChromosomeRegions());
+    int32_t nids = parseGTFAll(c, features, overlappingRegions, geneIds, pCoding);
     
     // Make intervals non-overlapping for each label
-    for(uint32_t refIndex = 0; refIndex < overlappingRegions.size(); ++refIndex) {
-      // Sort by ID
-      std::sort(overlappingRegions[refIndex].begin(), overlappingRegions[refIndex].end(), SortIntervalLabel<IntervalLabel>());
-      int32_t runningId = -1;
-      char runningStrand = '*';
-      typedef boost::icl::interval_set<uint32_t> TIdIntervals;
-      typedef typename TIdIntervals::interval_type TIVal;
-      TIdIntervals idIntervals;
-      for(uint32_t i = 0; i < overlappingRegions[refIndex].size(); ++i) {
-	if (overlappingRegions[refIndex][i].lid != runningId) {
-	  for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) {
-	    //std::cerr << "merged\t" << geneIds[runningId] << "\t" << it->lower() << "\t" << it->upper() << std::endl;  
-	    gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
-	  }
-	  idIntervals.clear();
-	  runningId = overlappingRegions[refIndex][i].lid;
-	  runningStrand = overlappingRegions[refIndex][i].strand;
-	}
-	idIntervals.insert(TIVal::right_open(overlappingRegions[refIndex][i].start, overlappingRegions[refIndex][i].end));
+    for(uint32_t k = 0; k < features.size(); ++k) {
+      for(uint32_t refIndex = 0; refIndex < overlappingRegions[k].size(); ++refIndex) {
+	_mergeLabelIntervals(overlappingRegions[k][refIndex], gRegions[k][refIndex]);
       }
-      // Process last id
-      for(typename TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) gRegions[refIndex].push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
     }
-    
-    return geneIds.size();
+    return nids;
+  }
+
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds, typename TProteinCoding>
+  inline int32_t
+  parseGTF(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, TProteinCoding& pCoding) {
+    std::vector<std::string> features(1, c.feature);
+    std::vector<TGenomicRegions> regions(1);
+    std::vector<TGeneIds> ids(1);
+    std::vector<TProteinCoding> coding(1);
+    regions[0].swap(gRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    int32_t nids = parseGTF(c, features, regions, ids, coding);
+    regions[0].swap(gRegions);
+    ids[0].swap(geneIds);
+    coding[0].swap(pCoding);
+    return nids;
   }
 
   template<typename TConfig, typename TGenomicRegions, typename TGeneIds>
@@ -0,0 +1,122 @@
+#ifndef ITREE_H
+#define ITREE_H
+
+#include <vector>
+
+#include "util.h"
+
+namespace sansa
+{
+
+  // Implicit augmented interval tree over a start-sorted feature array (cgranges layout)
+  struct ChromosomeIndex {
+    int32_t maxLevel;
+    std::vector<int32_t> maxEnd;
+
+    ChromosomeIndex() : maxLevel(-1) {}
+  };
+
+  template<typename TChromosomeRegions>
+  inline void
+  _buildChromosomeIndex(TChromosomeRegions const& cr, ChromosomeIndex& ci) {
+    int64_t n = cr.size();
+    ci.maxEnd.resize(n);
+    ci.maxLevel = -1;
+    if (n == 0) return;
+
+    // Leaves
+    int64_t lastI = 0;
+    int32_t last = 0;
+    for(int64_t i = 0; i < n; i += 2) {
+      lastI = i;
+      last = ci.maxEnd[i] = cr[i].end;
+    }
+
+    // Internal nodes, bottom-up
+    int32_t k = 1;
+    for(; (1LL << k) <= n; ++k) {
+      int64_t x = 1LL << (k - 1);
+      int64_t i0 = (x << 1) - 1;
+      int64_t step = x << 2;
+      for(int64_t i = i0; i < n; i += step) {
+	int32_t el = ci.maxEnd[i - x];
+	int32_t er = (i + x < n) ? ci.maxEnd[i + x] : last;
+	ci.maxEnd[i] = std::max(cr[i].end, std::max(el, er));
+      }
+      // Parent of the rightmost node
+      lastI = ((lastI >> k) & 1) ? lastI - x : lastI + x;
+      if ((lastI < n) && (ci.maxEnd[lastI] > last)) last = ci.maxEnd[lastI];
+    }
+    ci.maxLevel = k - 1;
+  }
+
+  template<typename TGenomicRegions, typename TGenomicIndex>
+  inline void
+  buildIntervalIndex(TGenomicRegions const& gRegions, TGenomicIndex& gIndex) {
+    gIndex.clear();
+    gIndex.resize(gRegions.size(), ChromosomeIndex());
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) _buildChromosomeIndex(gRegions[refIndex], gIndex[refIndex]);
+  }
+
+  // Offsets of all features with start <= qe and end >= qs, in array order
+  template<typename TChromosomeRegions>
+  inline void
+  _overlapQuery(TChromosomeRegions const& cr, ChromosomeIndex const& ci, int32_t const qs, int32_t const qe, std::vector<int32_t>& hits) {
+    hits.clear();
+    if (ci.maxLevel < 0) return;
+
+    struct StackItem {
+      int32_t k;
+      int32_t w;
+      int64_t x;
+    };
+    StackItem stack[64];
+    int32_t t = 0;
+    int64_t n = cr.size();
+    stack[t].k = ci.maxLevel;
+    stack[t].x = (1LL << ci.maxLevel) - 1;
+    stack[t++].w = 0;
+    while (t) {
+      StackItem z = stack[--t];
+      if (z.k <= 3) {
+	// Small subtree, linear scan
+	int64_t i0 = z.x >> z.k << z.k;
+	int64_t i1 = i0 + (1LL << (z.k + 1)) - 1;
+	if (i1 >= n) i1 = n;
+	for(int64_t i = i0; (i < i1) && (cr[i].start <= qe); ++i) {
+	  if (qs <= cr[i].end) hits.push_back(i);
+	}
+      } else if (z.w == 0) {
+	// Revisit node after its left subtree
+	int64_t y = z.x - (1LL << (z.k - 1));
+	stack[t].k = z.k;
+	stack[t].x = z.x;
+	stack[t++].w = 1;
+	if ((y >= n) || (ci.maxEnd[y] >= qs)) {
+	  stack[t].k = z.k - 1;
+	  stack[t].x = y;
+	  stack[t++].w = 0;
+	}
+      } else if ((z.x < n) && (cr[z.x].start <= qe)) {
+	if (qs <= cr[z.x].end) hits.push_back(z.x);
+	stack[t].k = z.k - 1;
+	stack[t].x = z.x + (1LL << (z.k - 1));
+	stack[t++].w = 0;
+      }
+    }
+  }
+
+  // Offsets of all features fully contained in [qs, qe], in array order
+  template<typename TChromosomeRegions>
+  inline void
+  _containedQuery(TChromosomeRegions const& cr, int32_t const qs, int32_t const qe, std::vector<int32_t>& hits) {
+    hits.clear();
+    typename TChromosomeRegions::const_iterator itg = std::lower_bound(cr.begin(), cr.end(), IntervalLabel(qs));
+    for(; (itg != cr.end()) && (itg->start <= qe); ++itg) {
+      if (itg->end <= qe) hits.push_back(itg - cr.begin());
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef LAZYDB_H
+#define LAZYDB_H
+
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <htslib/vcf.h>
+#include <htslib/tbx.h>
+#include <htslib/kstring.h>
+
+#include "util.h"
+#include "parsedb.h"
+
+namespace sansa
+{
+
+  // Max. gap between two database regions that are fetched with a single index lookup
+  #define SANSA_LAZY_COALESCE 16384
+
+  // Database region around a query breakpoint, 0-based and half-open on a database contig
+  struct DbRegion {
+    int32_t rid;
+    int32_t beg;
+    int32_t end;
+
+    DbRegion(int32_t const r, int32_t const b, int32_t const e) : rid(r), beg(b), end(e) {}
+
+    bool operator<(const DbRegion& r2) const {
+      return ((rid < r2.rid) || ((rid == r2.rid) && (beg < r2.beg)));
+    }
+  };
+
+  // Database regions that can hold a match for any query SV, sorted and coalesced
+  template<typename TConfig>
+  inline bool
+  _queryRegions(TConfig const& c, bcf_hdr_t* dbhdr, std::vector<DbRegion>& regions) {
+    // Unified chromosome index -> database contig
+    std::vector<int32_t> dbRid(chrMapSize(c.nchr), -1);
+    for(int32_t rid = 0; rid < dbhdr->n[BCF_DT_CTG]; ++rid) {
+      int32_t refIndex = _chrIndex(c.nchr, std::string(bcf_hdr_id2name(dbhdr, rid)));
+      if ((refIndex < (int32_t) dbRid.size()) && (dbRid[refIndex] == -1)) dbRid[refIndex] = rid;
+    }
+
+    htsFile* ifile = bcf_open(c.infile.string().c_str(), "r");
+    if (ifile == NULL) {
+      std::cerr << "Fail to load " << c.infile.string() << std::endl;
+      return false;
+    }
+    _attachThreadPool(ifile, c.tpool);
+    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
+    SVRecordFields f;
+    bcf1_t* rec = bcf_init();
+    std::vector<int32_t> ridMap(hdr->n[BCF_DT_CTG], 0);
+    for(int32_t rid = 0; rid < hdr->n[BCF_DT_CTG]; ++rid) ridMap[rid] = _chrIndex(c.nchr, std::string(bcf_hdr_id2name(hdr, rid)));
+    std::vector<DbRegion> bp;
+    while (bcf_read(ifile, hdr, rec) == 0) {
+      if (!_decodeSVRecord(dec, rec, f)) continue;
+      SV qsv(ridMap[rec->rid], rec->pos + 1, _chrIndex(c.nchr, f.chr2Name), f.svEnd);
+      _makeCanonical(qsv);
+
+      // Matches are within bpwindow of the canonical start, inter-chromosomal database records may sit at their second breakpoint
+      if ((qsv.chr < (int32_t) dbRid.size()) && (dbRid[qsv.chr] != -1)) bp.push_back(DbRegion(dbRid[qsv.chr], std::max(0, qsv.svStart - 1 - c.bpwindow), qsv.svStart + c.bpwindow));
+      if ((qsv.chr != qsv.chr2) && (qsv.chr2 < (int32_t) dbRid.size()) && (dbRid[qsv.chr2] != -1)) bp.push_back(DbRegion(dbRid[qsv.chr2], std::max(0, qsv.svEnd - 1 - c.bpwindow), qsv.svEnd + c.bpwindow));
+    }
+    bcf_destroy(rec);
+    bcf_hdr_destroy(hdr);
+    bcf_close(ifile);
+
+    // Coalesce neighbouring regions
+    std::sort(bp.begin(), bp.end());
+    regions.clear();
+    for(uint32_t i = 0; i < bp.size(); ++i) {
+      if ((!regions.empty()) && (regions.back().rid == bp[i].rid) && (bp[i].beg <= regions.back().end + SANSA_LAZY_COALESCE)) {
+	if (bp[i].end > regions.back().end) regions.back().end = bp[i].end;
+      } else regions.push_back(bp[i]);
+    }
+    return true;
+  }
+
+  inline bool
+  _nextIndexedRecord(htsFile* ifile, bcf_hdr_t* hdr, tbx_t* tbx, hts_itr_t* itr, kstring_t* str, bcf1_t* rec) {
+    if (tbx != NULL) {
+      if (tbx_itr_next(ifile, tbx, itr, str) < 0) return false;
+      return (vcf_parse(str, hdr, rec) == 0);
+    }
+    return (bcf_itr_next(ifile, itr, rec) >= 0);
+  }
+
+  // Parse only the indexed database regions near query SVs, ANNOIDs follow the fetch order
+  template<typename TConfig, typename TSV>
+  inline bool
+  parseDBRegions(TConfig const& c, DatabaseConfig const& d, TSV& svs, DbFields& fields) {
+
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Fetch SV annotation database regions" << std::endl;
+
+    // Load bcf file and index
+    htsFile* ifile = bcf_open(d.db.string().c_str(), "r");
+    if (ifile == NULL) {
+      std::cerr << "Fail to load " << d.db.string() << std::endl;
+      return false;
+    }
+    _attachThreadPool(ifile, c.tpool);
+    hts_idx_t* bcfidx = NULL;
+    tbx_t* tbx = NULL;
+    if (hts_get_format(ifile)->format == vcf) tbx = tbx_index_load(d.db.string().c_str());
+    else bcfidx = bcf_index_load(d.db.string().c_str());
+    if ((bcfidx == NULL) && (tbx == NULL)) {
+      std::cerr << "Fail to open index file for " << d.db.string() << ", lazy mode requires a CSI/TBI indexed database" << std::endl;
+      return false;
+    }
+    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
+    SVRecordFields svFields;
+
+    // Regions around query breakpoints
+    std::vector<DbRegion> regions;
+    if (!_queryRegions(c, hdr, regions)) return false;
+
+    // Open output VCF file
+    htsFile* ofile = NULL;
+    bcf_hdr_t* hdr_out = NULL;
+    if ((!d.annofile.empty()) && (!_openAnnoFile(c, d, hdr, ofile, hdr_out))) return false;
+
+    // Database fields to project into the query output
+    fields.init(d.dbFields);
+    std::vector<int32_t> fieldType;
+    if (!_dbFieldTypes(d, hdr, fieldType)) return false;
+    void* fieldBuf = NULL;
+    int32_t nFieldBuf = 0;
+    std::string fieldVal;
+
+    // Fetch regions, each record is read once because regions are disjoint and records are assigned by POS
+    bcf1_t* rec = bcf_init();
+    kstring_t str = {0, 0, 0};
+    int32_t svid = 0;
+    int32_t sitecount = 0;
+    for(uint32_t i = 0; i < regions.size(); ++i) {
+      hts_itr_t* itr = NULL;
+      if (tbx != NULL) itr = tbx_itr_queryi(tbx, tbx_name2id(tbx, bcf_hdr_id2name(hdr, regions[i].rid)), regions[i].beg, regions[i].end);
+      else itr = bcf_itr_queryi(bcfidx, regions[i].rid, regions[i].beg, regions[i].end);
+      if (itr == NULL) continue;
+      std::string chrName = bcf_hdr_id2name(hdr, regions[i].rid);
+      int32_t refIndex = _chrIndex(c.nchr, chrName);
+      while (_nextIndexedRecord(ifile, hdr, tbx, itr, &str, rec)) {
+	if ((rec->pos < regions[i].beg) || (rec->pos >= regions[i].end)) continue;
+	++sitecount;
+
+	// Store SV
+	SV dbsv;
+	if (_parseDbRecord(c, dec, rec, refIndex, svid, svFields, dbsv)) {
+	  svs.push_back(dbsv);
+	  _writeAnnoRecord(ofile, hdr_out, rec, svid);
+	  for(uint32_t f = 0; f < fieldType.size(); ++f) {
+	    _dbFieldValue(hdr, rec, d.dbFields[f], fieldType[f], &fieldBuf, &nFieldBuf, fieldVal);
+	    fields.push_back(f, fieldVal);
+	  }
+	  ++svid;
+	}
+      }
+      hts_itr_destroy(itr);
+    }
+    bcf_destroy(rec);
+    if (str.s != NULL) free(str.s);
+    if (fieldBuf != NULL) free(fieldBuf);
+
+    // Sort SVs
+    sort(svs.begin(), svs.end());
+
+    // Statistics
+    now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Fetched " << regions.size() << " database regions, parsed " << svid << " out of " << sitecount << " VCF/BCF records." << std::endl;
+
+    // Close output VCF
+    if (ofile != NULL) {
+      bcf_hdr_destroy(hdr_out);
+      hts_close(ofile);
+    }
+    bcf_hdr_destroy(hdr);
+    if (bcfidx) hts_idx_destroy(bcfidx);
+    if (tbx) tbx_destroy(tbx);
+    bcf_close(ifile);
+
+    // Build BCF index
+    if (!d.annofile.empty()) bcf_index_build(d.annofile.string().c_str(), 14);
+
+    return true;
+  }
+
+}
+
+#endif
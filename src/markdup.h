@@ -37,6 +37,7 @@
 #include "edlib.h"
 #include "version.h"
 #include "util.h"
+#include "decoder.h"
 
 namespace sansa
 {
@@ -70,6 +71,8 @@ namespace sansa
     float sizeratio;
     float divergence;
     float sharedcarrier;
+    int32_t threads;
+    htsThreadPool tpool;
     boost::filesystem::path outfile;
     boost::filesystem::path vcffile;
   };
@@ -107,50 +110,29 @@ namespace sansa
     
     // Load bcf file
     htsFile* ifile = hts_open(c.vcffile.string().c_str(), "r");
+    _attachThreadPool(ifile, c.tpool);
     bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
 
     // VCF fields
-    int32_t nsvend = 0;
-    int32_t* svend = NULL;
-    int32_t nconsbp = 0;
-    int32_t* consbp = NULL;
     int32_t svEndVal;
-    int32_t nsvt = 0;
-    char* svt = NULL;
     std::string svtVal;
-    int32_t nct = 0;
-    char* ct = NULL;
     std::string ctVal;
-    int32_t ninslen = 0;
-    int32_t* inslen = NULL;
-    int ngt = 0;
-    int32_t* gt = NULL;
-    int ngq = 0;
-    int32_t* gq = NULL;
-    float* gqf = NULL;
-    int ndv = 0;
-    int32_t* dv = NULL;
-    int ndr = 0;
-    int32_t* dr = NULL;
-    int nrv = 0;
-    int32_t* rv = NULL;
-    int nrr = 0;
-    int32_t* rr = NULL;
-    int32_t ncons = 0;
-    char* cons = NULL;
+    std::string consVal;
     
     // Parse BCF
     std::cerr << '[' << boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()) << "] " << "Parsing VCF/BCF file" << std::endl;
     bcf1_t* rec = bcf_init1();
+    uint64_t nrec = 0;
+    boost::posix_time::ptime decodeStart = boost::posix_time::microsec_clock::local_time();
     while (bcf_read(ifile, hdr, rec) == 0) {
+      ++nrec;
       bcf_unpack(rec, BCF_UN_INFO);
 
       // Check SV type
-      if (_isKeyPresent(hdr, "SVTYPE")) {
-	bcf_get_info_string(hdr, rec, "SVTYPE", &svt, &nsvt);
-	svtVal = std::string(svt);
-	bcf_get_info_string(hdr, rec, "CT", &ct, &nct);
-	ctVal = std::string(ct);
+      if (dec.present(SVD_SVTYPE)) {
+	dec.infoString(rec, SVD_SVTYPE, svtVal);
+	dec.infoString(rec, SVD_CT, ctVal);
       } else {
 	std::string refAllele = rec->d.allele[0];
 	std::string altAllele = rec->d.allele[1];
@@ -164,9 +146,8 @@ namespace sansa
       }
 
       // Check size and PASS
-      if (_isKeyPresent(hdr, "END")) {
-	bcf_get_info_int32(hdr, rec, "END", &svend, &nsvend);
-	svEndVal = *svend;
+      if (dec.present(SVD_END)) {
+	dec.infoInt32(rec, SVD_END, svEndVal);
       } else {
 	std::string refAllele = rec->d.allele[0];
 	std::string altAllele = rec->d.allele[1];
@@ -176,17 +157,17 @@ namespace sansa
       bool pass = true;
       if (c.filterForPass) pass = (bcf_has_filter(hdr, rec, const_cast<char*>("PASS"))==1);
       int32_t inslenVal = 0;
-      if (_isKeyPresent(hdr, "INSLEN")) {
-	if (bcf_get_info_int32(hdr, rec, "INSLEN", &inslen, &ninslen) > 0) inslenVal = *inslen;
+      if (dec.present(SVD_INSLEN)) {
+	dec.infoInt32(rec, SVD_INSLEN, inslenVal);
       } else {
 	std::string refAllele = rec->d.allele[0];
 	std::string altAllele = rec->d.allele[1];
 	if (refAllele.size() < altAllele.size()) inslenVal = altAllele.size() - refAllele.size();
       }
       bool precise = false;
-      if (bcf_get_info_flag(hdr, rec, "PRECISE", 0, 0) > 0) precise=true;
+      if (dec.infoFlag(rec, SVD_PRECISE)) precise=true;
       else {
-	if (_isKeyPresent(hdr, "CONSENSUS")) precise=true;
+	if (dec.present(SVD_CONSENSUS)) precise=true;
       }	
       if ((rec->qual >= c.qualthres) && (pass)) {
 	// Define SV event
@@ -205,38 +186,33 @@ namespace sansa
 	  sv.svLen = inslenVal;
 	}
 	if (precise) {
-	  if (bcf_get_info_string(hdr, rec, "CONSENSUS", &cons, &ncons) > 0) {
-	    if (bcf_get_info_int32(hdr, rec, "CONSBP", &consbp, &nconsbp) > 0) {
-	      sv.consensus = boost::to_upper_copy(std::string(cons));
-	      sv.consBp = *consbp;
-	    }
+	  if (dec.infoString(rec, SVD_CONSENSUS, consVal)) {
+	    if (dec.infoInt32(rec, SVD_CONSBP, sv.consBp)) sv.consensus = boost::to_upper_copy(consVal);
 	  }
 	}
 	
 	// Check genotypes
 	bcf_unpack(rec, BCF_UN_ALL);
 	bool precise = false;
-	if (bcf_get_info_flag(hdr, rec, "PRECISE", 0, 0) > 0) precise = true;
-	bcf_get_format_int32(hdr, rec, "GT", &gt, &ngt);
-	if (_isKeyPresent(hdr, "GQ")) {
-	  if (_getFormatType(hdr, "GQ") == BCF_HT_INT) bcf_get_format_int32(hdr, rec, "GQ", &gq, &ngq);
-	  else if (_getFormatType(hdr, "GQ") == BCF_HT_REAL) bcf_get_format_float(hdr, rec, "GQ", &gqf, &ngq);
-	}
-	if (_isKeyPresent(hdr, "DV")) bcf_get_format_int32(hdr, rec, "DV", &dv, &ndv);
-	if (_isKeyPresent(hdr, "DR")) bcf_get_format_int32(hdr, rec, "DR", &dr, &ndr);
-	if (_isKeyPresent(hdr, "RV")) bcf_get_format_int32(hdr, rec, "RV", &rv, &nrv);
-	if (_isKeyPresent(hdr, "RR")) bcf_get_format_int32(hdr, rec, "RR", &rr, &nrr);
+	if (dec.infoFlag(rec, SVD_PRECISE)) precise = true;
+	int32_t* gt = dec.formatInt32(rec, SVD_GT);
+	int32_t* gq = NULL;
+	float* gqf = NULL;
+	if (dec.gqType == BCF_HT_INT) gq = dec.formatInt32(rec, SVD_GQ);
+	else if (dec.gqType == BCF_HT_REAL) gqf = dec.formatGQFloat(rec);
+	int32_t* dv = dec.formatInt32(rec, SVD_DV);
+	int32_t* dr = dec.formatInt32(rec, SVD_DR);
+	int32_t* rv = dec.formatInt32(rec, SVD_RV);
+	int32_t* rr = dec.formatInt32(rec, SVD_RR);
 
 	sv.vaf.resize(bcf_hdr_nsamples(hdr), 0);
 	sv.gq.resize(bcf_hdr_nsamples(hdr), 0);
 	sv.gt.resize(bcf_hdr_nsamples(hdr), 0);
-	for (int i = 0; i < bcf_hdr_nsamples(hdr); ++i) {
+	for (int i = 0; (gt != NULL) && (i < bcf_hdr_nsamples(hdr)); ++i) {
 	  if ((bcf_gt_allele(gt[i*2]) != -1) && (bcf_gt_allele(gt[i*2 + 1]) != -1)) {
 	    sv.gt[i] = bcf_gt_allele(gt[i*2]) + bcf_gt_allele(gt[i*2 + 1]);
-	    if (gq != NULL) {
-	      if (_getFormatType(hdr, "GQ") == BCF_HT_INT) sv.gq[i] = gq[i];
-	      else if (_getFormatType(hdr, "GQ") == BCF_HT_REAL) sv.gq[i] = gqf[i];
-	    }
+	    if (gq != NULL) sv.gq[i] = gq[i];
+	    else if (gqf != NULL) sv.gq[i] = gqf[i];
 	    float rVar = 0;
 	    if (!precise) {
 	      if ((dv != NULL) && (dr != NULL)) rVar = (float) dv[i] / (float) (dr[i] + dv[i]);
@@ -257,23 +233,9 @@ namespace sansa
 	}
       }
     }
+    _decodeRate(nrec, decodeStart);
     bcf_destroy(rec);
 
-    // Clean-up
-    if (svend != NULL) free(svend);
-    if (consbp != NULL) free(consbp);
-    if (svt != NULL) free(svt);
-    if (ct != NULL) free(ct);
-    if (inslen != NULL) free(inslen);
-    if (gt != NULL) free(gt);
-    if (gq != NULL) free(gq);
-    if (gqf != NULL) free(gqf);
-    if (dv != NULL) free(dv);
-    if (dr != NULL) free(dr);
-    if (rv != NULL) free(rv);
-    if (rr != NULL) free(rr);
-    if (cons != NULL) free(cons);
-
     // Close VCF
     bcf_hdr_destroy(hdr);
     bcf_close(ifile);
@@ -288,12 +250,14 @@ namespace sansa
 
     // Load bcf file
     htsFile* ifile = hts_open(c.vcffile.string().c_str(), "r");
+    _attachThreadPool(ifile, c.tpool);
     bcf_hdr_t* hdr = bcf_hdr_read(ifile);
 
     // Open output VCF file
     std::string fmtout = "wb";
     if (c.outfile.string() == "-") fmtout = "w";
     htsFile *ofile = hts_open(c.outfile.string().c_str(), fmtout.c_str());
+    _attachThreadPool(ofile, c.tpool);
     bcf_hdr_t *hdr_out = bcf_hdr_dup(hdr);
     if (c.softFilter) {
       bcf_hdr_append(hdr_out, "##FILTER=<ID=Duplicate,Description=\"Marked duplicate.\">");
@@ -418,20 +382,30 @@ namespace sansa
   
 
   inline int
-  markdupRun(MarkdupConfig const& c) {
+  markdupRun(MarkdupConfig& c) {
+
+    // Shared htslib thread pool
+    ThreadPoolGuard poolGuard(c.tpool, c.threads);
 
     // Load SVs
+    boost::posix_time::ptime stage = boost::posix_time::microsec_clock::local_time();
     std::vector<SVEvent> allsv;
     if (!_loadSVEvents(c, allsv)) return -1;
+    _stageTime("SV loading", stage);
 
     // Sort SVs
+    stage = boost::posix_time::microsec_clock::local_time();
     sort(allsv.begin(), allsv.end());
 
     // Mark duplicates
     _markDuplicates(c, allsv);
+    _stageTime("Duplicate marking", stage);
 
     // Write non-duplicate SV sites
+    stage = boost::posix_time::microsec_clock::local_time();
     if (!_writeUniqueSVs(c, allsv)) return -1;
+    _stageTime("SV output", stage);
+    _destroyThreadPool(c.tpool);
 
     return 0;
   }
@@ -452,6 +426,7 @@ namespace sansa
       ("carrier,c", boost::program_options::value<float>(&c.sharedcarrier)->default_value(0.25), "min. fraction of shared SV carriers")
       ("pass,p", "Filter sites for PASS")
       ("tag,t", "Tag duplicate marked sites in the FILTER column instead of removing them")
+      ("threads", boost::program_options::value<int32_t>(&c.threads)->default_value(1), "number of compression threads")
       ;
     
     // Define hidden options
@@ -480,6 +455,9 @@ namespace sansa
       return 0;
     }
     
+    // Check threads
+    if (c.threads < 1) c.threads = 1;
+
     // Filter for PASS
     if (vm.count("pass")) c.filterForPass = true;
     else c.filterForPass = false;
@@ -0,0 +1,118 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <memory>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "util.h"
+#include "summary.h"
+
+namespace sansa
+{
+
+  // Canonical coordinates, type and size of a query SV, all that database matching and gene annotation depend on
+  struct SVKey {
+    int32_t chr;
+    int32_t svStart;
+    int32_t chr2;
+    int32_t svEnd;
+    int32_t svt;
+    int32_t svlen;
+
+    explicit SVKey(SV const& sv) : chr(sv.chr), svStart(sv.svStart), chr2(sv.chr2), svEnd(sv.svEnd), svt(sv.svt), svlen(sv.svlen) {}
+
+    bool operator==(SVKey const& k2) const {
+      return ((svStart == k2.svStart) && (svEnd == k2.svEnd) && (chr == k2.chr) && (chr2 == k2.chr2) && (svt == k2.svt) && (svlen == k2.svlen));
+    }
+  };
+
+  inline std::size_t
+  hash_value(SVKey const& k) {
+    std::size_t seed = 0;
+    boost::hash_combine(seed, k.chr);
+    boost::hash_combine(seed, k.svStart);
+    boost::hash_combine(seed, k.chr2);
+    boost::hash_combine(seed, k.svEnd);
+    boost::hash_combine(seed, k.svt);
+    boost::hash_combine(seed, k.svlen);
+    return seed;
+  }
+
+  // Nearby and contained features of a query SV in one annotation track
+  struct FeatureMatch {
+    std::string featureBp1;
+    std::string featureBp2;
+    std::string featureContained;
+    ContainedSummary summary;
+  };
+
+  // Matches of a query SV in one SV database
+  struct DbMatch {
+    std::vector<int32_t> ids;   // All matches (strategy all)
+    int32_t bestID;
+    float bestScore;
+    bool noMatch;
+
+    DbMatch() : bestID(-1), bestScore(-1), noMatch(true) {}
+  };
+
+  // Database matches and nearby features of a query SV
+  struct SVMatch {
+    std::vector<DbMatch> dbs;   // One per SV database
+    std::vector<FeatureMatch> features;   // One per annotation track
+  };
+
+  // Bounded memo cache of query SV matches, shared by all query threads
+  // The cache is cleared once it holds maxSize keys, repeated keys are usually close in sorted input
+  // Matches are immutable and shared, only a pointer is copied inside the critical section
+  struct QueryMemo {
+    typedef std::shared_ptr<SVMatch const> TMatchPtr;
+    typedef boost::unordered_map<SVKey, TMatchPtr> TMemoMap;
+    TMemoMap memo;
+    uint32_t maxSize;
+    uint64_t lookups;
+    uint64_t hits;
+
+    explicit QueryMemo(uint32_t const m) : maxSize(m), lookups(0), hits(0) {}
+
+    // Null if the key is not cached
+    TMatchPtr find(SVKey const& key) {
+      TMatchPtr match;
+      if (!maxSize) return match;
+#pragma omp critical(sansaQueryMemo)
+      {
+	++lookups;
+	TMemoMap::const_iterator it = memo.find(key);
+	if (it != memo.end()) {
+	  match = it->second;
+	  ++hits;
+	}
+      }
+      return match;
+    }
+
+    void insert(SVKey const& key, TMatchPtr const& match) {
+      if (!maxSize) return;
+#pragma omp critical(sansaQueryMemo)
+      {
+	if (memo.size() >= maxSize) memo.clear();
+	memo.insert(std::make_pair(key, match));
+      }
+    }
+
+    void statistics() const {
+      if (!maxSize) return;
+      boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+      std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Memo cache: " << hits << " of " << lookups << " query SVs reused a previous match";
+      if (lookups) std::cerr << " (" << (100.0 * hits / lookups) << "%)";
+      std::cerr << '.' << std::endl;
+    }
+  };
+
+}
+
+#endif
@@ -12,34 +12,146 @@
 #include <htslib/faidx.h>
 #include <htslib/vcf.h>
 
+#include "svdb.h"
+#include "decoder.h"
+#include "rowwriter.h"
+
 namespace sansa
 {
 
 
+  // Text value of a database INFO field (or the VCF ID), NA if missing
+  inline void
+  _dbFieldValue(bcf_hdr_t* hdr, bcf1_t* rec, std::string const& name, int32_t const ftype, void** buf, int32_t* nbuf, std::string& val) {
+    val.clear();
+    if (ftype == -1) {
+      val = rec->d.id;
+      return;
+    }
+    if (ftype == BCF_HT_FLAG) {
+      if (bcf_get_info_flag(hdr, rec, name.c_str(), NULL, NULL) > 0) val = "1";
+      else val = "0";
+      return;
+    }
+    int32_t n = bcf_get_info_values(hdr, rec, name.c_str(), buf, nbuf, ftype);
+    if (n <= 0) {
+      val = "NA";
+      return;
+    }
+    if (ftype == BCF_HT_STR) {
+      val = std::string((char*) *buf);
+    } else if (ftype == BCF_HT_INT) {
+      int32_t* arr = (int32_t*) *buf;
+      for(int32_t i = 0; i < n; ++i) {
+	if (arr[i] == bcf_int32_vector_end) break;
+	if (i) val += ',';
+	if (arr[i] == bcf_int32_missing) val += '.';
+	else _appendInt(val, arr[i]);
+      }
+    } else if (ftype == BCF_HT_REAL) {
+      float* arr = (float*) *buf;
+      char fstr[32];
+      for(int32_t i = 0; i < n; ++i) {
+	if (bcf_float_is_vector_end(arr[i])) break;
+	if (i) val += ',';
+	if (bcf_float_is_missing(arr[i])) val += '.';
+	else {
+	  snprintf(fstr, sizeof(fstr), "%g", arr[i]);
+	  val += fstr;
+	}
+      }
+    }
+  }
+
+  // Decode a database record into a canonical SV, false if the record cannot be parsed
+  template<typename TConfig>
+  inline bool
+  _parseDbRecord(TConfig const& c, SVRecordDecoder const& dec, bcf1_t* rec, int32_t const refIndex, int32_t const svid, SVRecordFields& f, SV& dbsv) {
+    if (!_decodeSVRecord(dec, rec, f)) return false;
+
+    dbsv = SV(refIndex, rec->pos + 1, _chrIndex(c.nchr, f.chr2Name), f.svEnd, svid, f.qual, f.svt, f.svlen);
+    _makeCanonical(dbsv);
+    return true;
+  }
+
+  // Header types of the requested database fields, -1 for the VCF ID
+  inline bool
+  _dbFieldTypes(DatabaseConfig const& d, bcf_hdr_t* hdr, std::vector<int32_t>& fieldType) {
+    fieldType.assign(d.dbFields.size(), -1);
+    for(uint32_t f = 0; f < d.dbFields.size(); ++f) {
+      if (d.dbFields[f] == "ID") continue;
+      int32_t tagid = bcf_hdr_id2int(hdr, BCF_DT_ID, d.dbFields[f].c_str());
+      if (!bcf_hdr_idinfo_exists(hdr, BCF_HL_INFO, tagid)) {
+	std::cerr << "Database field INFO/" << d.dbFields[f] << " is missing in " << d.db.string() << std::endl;
+	return false;
+      }
+      fieldType[f] = bcf_hdr_id2type(hdr, BCF_HL_INFO, tagid);
+    }
+    return true;
+  }
+
+  // Annotation BCF with the database records and their ANNOID
+  template<typename TConfig>
+  inline bool
+  _openAnnoFile(TConfig const& c, DatabaseConfig const& d, bcf_hdr_t* hdr, htsFile*& ofile, bcf_hdr_t*& hdr_out) {
+    ofile = hts_open(d.annofile.string().c_str(), "wb");
+    if (ofile == NULL) {
+      std::cerr << "Fail to open output file " << d.annofile.string() << std::endl;
+      return false;
+    }
+    _attachThreadPool(ofile, c.tpool);
+    hdr_out = bcf_hdr_dup(hdr);
+    bcf_hdr_remove(hdr_out, BCF_HL_INFO, "ANNOID");
+    bcf_hdr_append(hdr_out, "##INFO=<ID=ANNOID,Number=1,Type=String,Description=\"Annotation ID that links query SVs to database SVs.\">");
+    if (bcf_hdr_write(ofile, hdr_out) != 0) {
+      std::cerr << "Error: Failed to write BCF header!" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Nothing is written without an annotation file (--noanno)
+  inline void
+  _writeAnnoRecord(htsFile* ofile, bcf_hdr_t* hdr_out, bcf1_t* rec, int32_t const svid) {
+    if (ofile == NULL) return;
+    std::string id;
+    _appendAnnoId(id, svid);
+    _remove_info_tag(hdr_out, rec, "ANNOID");
+    bcf_update_info_string(hdr_out, rec, "ANNOID", id.c_str());
+    bcf_write1(ofile, hdr_out, rec);
+  }
+
+  // hasCT is set if any database record carries a CT field
   template<typename TConfig, typename TSV>
   inline bool
-  parseDB(TConfig& c, TSV& svs) {
+  parseDB(TConfig const& c, DatabaseConfig const& d, TSV& svs, DbFields& fields, bool& hasCT) {
 
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Parse SV annotation database" << std::endl;
     
     // Load bcf file
-    htsFile* ifile = bcf_open(c.db.string().c_str(), "r");
+    htsFile* ifile = bcf_open(d.db.string().c_str(), "r");
     if (ifile == NULL) {
-      std::cerr << "Fail to load " << c.db.string() << std::endl;
+      std::cerr << "Fail to load " << d.db.string() << std::endl;
       return false;
     }
+    _attachThreadPool(ifile, c.tpool);
     bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    SVRecordDecoder dec(hdr);
+    SVRecordFields svFields;
     
     // Open output VCF file
-    htsFile *ofile = hts_open(c.annofile.string().c_str(), "wb");
-    bcf_hdr_t *hdr_out = bcf_hdr_dup(hdr);
-    bcf_hdr_remove(hdr_out, BCF_HL_INFO, "ANNOID");
-    bcf_hdr_append(hdr_out, "##INFO=<ID=ANNOID,Number=1,Type=String,Description=\"Annotation ID that links query SVs to database SVs.\">");
-    if (bcf_hdr_write(ofile, hdr_out) != 0) {
-      std::cerr << "Error: Failed to write BCF header!" << std::endl;
-      return false;
-    }
+    htsFile* ofile = NULL;
+    bcf_hdr_t* hdr_out = NULL;
+    if ((!d.annofile.empty()) && (!_openAnnoFile(c, d, hdr, ofile, hdr_out))) return false;
+
+    // Database fields to project into the query output
+    fields.init(d.dbFields);
+    std::vector<int32_t> fieldType;
+    if (!_dbFieldTypes(d, hdr, fieldType)) return false;
+    void* fieldBuf = NULL;
+    int32_t nFieldBuf = 0;
+    std::string fieldVal;
 
     // Parse VCF records
     bcf1_t* rec = bcf_init();
@@ -47,10 +159,8 @@ namespace sansa
     int32_t sitecount = 0;
     int32_t lastRID = -1;
     int32_t refIndex = -1;
+    boost::posix_time::ptime decodeStart = boost::posix_time::microsec_clock::local_time();
     while (bcf_read(ifile, hdr, rec) == 0) {
-      int32_t startsv = rec->pos + 1;
-      bool parsed = true;
-
       // Count records
       ++sitecount;
       
@@ -58,57 +168,26 @@ namespace sansa
       if (rec->rid != lastRID) {
 	lastRID = rec->rid;
 	std::string chrName = bcf_hdr_id2name(hdr, rec->rid);
-	refIndex = c.nchr[chrName];
+	refIndex = _chrIndex(c.nchr, chrName);
       }
 
-      // Unpack INFO
-      bcf_unpack(rec, BCF_UN_INFO);
-
-      // Parse INFO fields
-      std::string svtval = "NA";
-      if (!_parseSVTYPE(hdr, rec, svtval)) parsed = false;
-      std::string ctval("NA");
-      if (_parse_bcf_string(hdr, rec, "CT", ctval)) c.hasCT = true;
-      std::string chr2Name(bcf_hdr_id2name(hdr, rec->rid));
-      _parse_bcf_string(hdr, rec, "CHR2", chr2Name);      
-      int32_t pos2val = -1;
-      _parse_bcf_int32(hdr, rec, "POS2", pos2val);
-      int32_t endval = -1;
-      _parse_bcf_int32(hdr, rec, "END", endval);
-      int32_t svlenval = 0;
-      _parse_bcf_int32(hdr, rec, "SVLEN", svlenval);
-
-      // Derive proper END and SVLEN
-      int32_t endsv = deriveEndPos(rec, svtval, pos2val, endval);
-      bool parseALTBND = parseAltBnd(hdr, rec, svtval, ctval, chr2Name, endsv);
-      if (!parseALTBND) parsed = false;
-      int32_t svlength = deriveSvLength(rec, svtval, endsv, svlenval);
-      
-      // Numerical SV type
-      int32_t svtint = _decodeOrientation(ctval, svtval);
-      if (svtint == -1) parsed = false;
-      int32_t qualval = 0;
-      if (rec->qual > 0) qualval = (int32_t) (rec->qual);
-
-      // Dump record
-      //std::cerr << parsed << "\t" << bcf_hdr_id2name(hdr, rec->rid) << "\t" << (rec->pos + 1) << "\t" << chr2Name << "\t" << endsv << "\t" << rec->d.id << "\t" << qualval << "\t" << svtval << "\t" << ctval << "\t" << svtint << "\t" << svlength << std::endl;
-
       // Store SV
+      SV dbsv;
+      bool parsed = _parseDbRecord(c, dec, rec, refIndex, svid, svFields, dbsv);
+      if (svFields.hasCT) hasCT = true;
       if (parsed) {
-	SV dbsv = SV(refIndex, startsv, c.nchr[chr2Name], endsv, svid, qualval, svtint, svlength);
-	_makeCanonical(dbsv);
 	svs.push_back(dbsv);
-	std::string id("id");
-	std::string padNumber = boost::lexical_cast<std::string>(svid);
-	padNumber.insert(padNumber.begin(), 9 - padNumber.length(), '0');
-	id += padNumber;
-	_remove_info_tag(hdr_out, rec, "ANNOID");
-	bcf_update_info_string(hdr_out, rec, "ANNOID", id.c_str());
-	bcf_write1(ofile, hdr_out, rec);
+	_writeAnnoRecord(ofile, hdr_out, rec, svid);
+	for(uint32_t f = 0; f < fieldType.size(); ++f) {
+	  _dbFieldValue(hdr, rec, d.dbFields[f], fieldType[f], &fieldBuf, &nFieldBuf, fieldVal);
+	  fields.push_back(f, fieldVal);
+	}
 	++svid;
       }
     }
+    _decodeRate(sitecount, decodeStart);
     bcf_destroy(rec);
+    if (fieldBuf != NULL) free(fieldBuf);
     
     // Sort SVs
     sort(svs.begin(), svs.end());
@@ -118,13 +197,15 @@ namespace sansa
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Parsed " << svid << " out of " << sitecount << " VCF/BCF records." << std::endl;
 	
     // Close output VCF
-    bcf_hdr_destroy(hdr_out);
+    if (ofile != NULL) {
+      bcf_hdr_destroy(hdr_out);
+      hts_close(ofile);
+    }
     bcf_hdr_destroy(hdr);
-    hts_close(ofile);
     bcf_close(ifile);
 
     // Build BCF index
-    bcf_index_build(c.annofile.string().c_str(), 14);
+    if (!d.annofile.empty()) bcf_index_build(d.annofile.string().c_str(), 14);
     
     return true;
   }
@@ -1,6 +1,8 @@
 #ifndef QUERY_H
 #define QUERY_H
 
+#include <string_view>
+
 #include <boost/dynamic_bitset.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/unordered_map.hpp>
@@ -12,16 +14,29 @@
 #include <htslib/sam.h>
 #include <htslib/faidx.h>
 #include <htslib/vcf.h>
+#include <htslib/bgzf.h>
+#include <htslib/tbx.h>
+#include <htslib/thread_pool.h>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
+
+#include "itree.h"
+#include "decoder.h"
+#include "rowwriter.h"
+#include "memo.h"
+#include "track.h"
 
 namespace sansa
 {
 
 
 
-  template<typename TConfig, typename TGenomicRegions, typename TGeneIds>
+  template<typename TConfig, typename TGenomicRegions, typename TGenomicIndex, typename TGeneIds>
   inline void
-  geneAnnotation(TConfig const& c, TGenomicRegions const& gRegions, TGeneIds const& geneIds, int32_t const refIndex, int32_t const svStart, int32_t const refIndex2, int32_t const svEnd, std::string& featureBp1, std::string& featureBp2, std::string& featureContained) {
-    typedef typename TGenomicRegions::value_type TChromosomeRegions;
+  geneAnnotation(TConfig const& c, TGenomicRegions const& gRegions, TGenomicIndex const& gIndex, TGeneIds const& geneIds, int32_t const refIndex, int32_t const svStart, int32_t const refIndex2, int32_t const svEnd, std::string& featureBp1, std::string& featureBp2, std::string& featureContained) {
+    std::vector<int32_t> hits;
 
     // Search nearby genes
     for(uint32_t bp = 0; bp < 2; ++bp) {
@@ -37,13 +52,13 @@ namespace sansa
 	rid = refIndex2;
 	bpoint = svEnd;
       }
-      for(typename TChromosomeRegions::const_iterator itg = gRegions[rid].begin(); itg != gRegions[rid].end(); ++itg) {
-	if (itg->start - bpoint > c.maxDistance) break;
-	if (bpoint - itg->end > c.maxDistance) continue;
+      _overlapQuery(gRegions[rid], gIndex[rid], bpoint - c.maxDistance, bpoint + c.maxDistance, hits);
+      for(uint32_t i = 0; i < hits.size(); ++i) {
+	IntervalLabel const& itg = gRegions[rid][hits[i]];
 	int32_t featureDist = 0;
-	if (bpoint > itg->end) featureDist = itg->end - bpoint;
-	if (bpoint < itg->start) featureDist = itg->start - bpoint;
-	dist.push_back(std::make_pair(featureDist, itg - gRegions[rid].begin()));
+	if (bpoint > itg.end) featureDist = itg.end - bpoint;
+	if (bpoint < itg.start) featureDist = itg.start - bpoint;
+	dist.push_back(std::make_pair(featureDist, hits[i]));
       }
 
       // Sort by distance
@@ -52,15 +67,15 @@ namespace sansa
       // Assign gene IDs
       bool firstFeature = true;
       for(uint32_t i = 0; i < dist.size(); ++i) {
-	if (!firstFeature) {
-	  if (!bp) featureBp1 += ",";
-	  else featureBp2 += ",";
-	} else firstFeature = false;
-	if (!bp) {
-	  featureBp1 += geneIds[gRegions[rid][dist[i].second].lid] + '(' + boost::lexical_cast<std::string>(dist[i].first) + ';' + gRegions[rid][dist[i].second].strand + ')' ;
-	} else {
-	  featureBp2 += geneIds[gRegions[rid][dist[i].second].lid] + '(' + boost::lexical_cast<std::string>(dist[i].first) + ';' + gRegions[rid][dist[i].second].strand + ')' ;
-	}
+	std::string& feature = bp ? featureBp2 : featureBp1;
+	if (!firstFeature) feature += ',';
+	else firstFeature = false;
+	feature += geneIds[gRegions[rid][dist[i].second].lid];
+	feature += '(';
+	_appendInt(feature, dist[i].first);
+	feature += ';';
+	feature += gRegions[rid][dist[i].second].strand;
+	feature += ')';
       }
     }
 
@@ -69,204 +84,543 @@ namespace sansa
     if (c.containedGenes) {
       if (refIndex == refIndex2) {
 	bool firstFeature = true;
-	for(typename TChromosomeRegions::const_iterator itg = gRegions[refIndex].begin(); itg != gRegions[refIndex].end(); ++itg) {
-	  if (itg->start > svEnd) break;
-	  if (itg->end < svStart) continue;
-	  // Fully contained?
-	  if ((svStart <= itg->start) && (itg->end <= svEnd)) {
-	    int32_t offset = itg - gRegions[refIndex].begin();
-	    if (!firstFeature) featureContained += ",";
-	    else firstFeature = false;
-	    featureContained += geneIds[gRegions[refIndex][offset].lid] + '(' + gRegions[refIndex][offset].strand + ')' ;
-	  }
+	_containedQuery(gRegions[refIndex], svStart, svEnd, hits);
+	for(uint32_t i = 0; i < hits.size(); ++i) {
+	  int32_t offset = hits[i];
+	  if (!firstFeature) featureContained += ',';
+	  else firstFeature = false;
+	  featureContained += geneIds[gRegions[refIndex][offset].lid];
+	  featureContained += '(';
+	  featureContained += gRegions[refIndex][offset].strand;
+	  featureContained += ')';
 	}
       }
     }
   }
 
 
+  // INFO tags of the annotated query BCF, one per database or annotation track
+  struct QueryInfoTags {
+    std::vector<std::string> annoId;
+    std::vector<std::string> annoScore;
+    std::vector<std::string> startFeature;
+    std::vector<std::string> endFeature;
+    std::vector<std::string> containedFeature;
+    std::vector<std::string> nfeatures;
+    std::vector<std::string> ncoding;
+    std::vector<std::string> covered;
+
+    template<typename TConfig>
+    void init(TConfig const& c) {
+      for(uint32_t k = 0; k < c.dbs.size(); ++k) {
+	std::string sfx = _columnSuffix(k);
+	annoId.push_back("ANNOID" + sfx);
+	annoScore.push_back("ANNOSCORE" + sfx);
+      }
+      for(uint32_t t = 0; t < c.tracks.size(); ++t) {
+	std::string sfx = _columnSuffix(t);
+	startFeature.push_back("STARTFEATURE" + sfx);
+	endFeature.push_back("ENDFEATURE" + sfx);
+	containedFeature.push_back("CONTAINEDFEATURE" + sfx);
+	nfeatures.push_back("NFEATURES" + sfx);
+	ncoding.push_back("NCODING" + sfx);
+	covered.push_back("COVERED" + sfx);
+      }
+    }
+  };
+
+  // Scratch buffers of one query thread, reused across records
+  struct QueryBuffers {
+    std::string qfields;
+    std::string dbfields;
+    std::string row;
+    std::string info;
+    std::vector<std::string> annoIds;
+    std::vector<std::string> cols;
+    std::vector<int32_t> ids;
+  };
+  
+  // Feature lists as INFO values, ';' is reserved in VCF INFO fields
+  inline void
+  _updateFeatureInfo(bcf_hdr_t* hdr_out, bcf1_t* rec, std::string const& tag, std::string const& feature, std::string& val) {
+    if (feature == "NA") return;
+    val = feature;
+    std::replace(val.begin(), val.end(), ';', '|');
+    bcf_update_info_string(hdr_out, rec, tag.c_str(), val.c_str());
+  }
+
+  template<typename TConfig>
+  inline void
+  _annotateRecord(TConfig const& c, QueryInfoTags const& tags, bcf_hdr_t* hdr_out, bcf1_t* rec, std::vector<std::string> const& annoIds, std::vector<DbMatch> const& matches, std::vector<FeatureMatch> const& features, std::string& val) {
+    for(uint32_t k = 0; k < tags.annoId.size(); ++k) {
+      _remove_info_tag(hdr_out, rec, tags.annoId[k]);
+      _remove_info_tag(hdr_out, rec, tags.annoScore[k]);
+    }
+    for(uint32_t t = 0; t < tags.startFeature.size(); ++t) {
+      _remove_info_tag(hdr_out, rec, tags.startFeature[t]);
+      _remove_info_tag(hdr_out, rec, tags.endFeature[t]);
+      _remove_info_tag(hdr_out, rec, tags.containedFeature[t]);
+      _remove_info_tag(hdr_out, rec, tags.nfeatures[t]);
+      _remove_info_tag(hdr_out, rec, tags.ncoding[t]);
+      _remove_info_tag(hdr_out, rec, tags.covered[t]);
+    }
+    for(uint32_t k = 0; (k < annoIds.size()) && (k < matches.size()) && (k < tags.annoId.size()); ++k) {
+      if (annoIds[k].empty()) continue;
+      bcf_update_info_string(hdr_out, rec, tags.annoId[k].c_str(), annoIds[k].c_str());
+      if (c.bestMatch) bcf_update_info_float(hdr_out, rec, tags.annoScore[k].c_str(), &matches[k].bestScore, 1);
+    }
+    for(uint32_t t = 0; (t < tags.startFeature.size()) && (t < features.size()); ++t) {
+      _updateFeatureInfo(hdr_out, rec, tags.startFeature[t], features[t].featureBp1, val);
+      _updateFeatureInfo(hdr_out, rec, tags.endFeature[t], features[t].featureBp2, val);
+      if (c.containedGenes) _updateFeatureInfo(hdr_out, rec, tags.containedFeature[t], features[t].featureContained, val);
+      ContainedSummary const& sum = features[t].summary;
+      if ((c.featureSummary) && (sum.nfeatures != -1)) {
+	bcf_update_info_int32(hdr_out, rec, tags.nfeatures[t].c_str(), &sum.nfeatures, 1);
+	bcf_update_info_int32(hdr_out, rec, tags.ncoding[t].c_str(), &sum.ncoding, 1);
+	bcf_update_info_float(hdr_out, rec, tags.covered[t].c_str(), &sum.covered, 1);
+      }
+    }
+  }
+
+  template<typename TConfig>
+  inline void
+  _appendQueryInfoHeader(TConfig const& c, QueryInfoTags const& tags, bcf_hdr_t* hdr_out) {
+    for(uint32_t k = 0; k < c.dbs.size(); ++k) {
+      std::string src = c.dbs[k].db.filename().string();
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.annoId[k].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.annoScore[k].c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.annoId[k] + ",Number=.,Type=String,Description=\"Annotation IDs of matched " + src + " SVs.\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.annoScore[k] + ",Number=1,Type=Float,Description=\"Match score of the best matching " + src + " SV.\">").c_str());
+    }
+    for(uint32_t t = 0; t < c.tracks.size(); ++t) {
+      std::string src = c.tracks[t].gtfFile.filename().string();
+      if ((c.tracks[t].gtfFileFormat == 0) || (c.tracks[t].gtfFileFormat == 2)) src += " (" + c.tracks[t].feature + ")";
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.startFeature[t].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.endFeature[t].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.containedFeature[t].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.nfeatures[t].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.ncoding[t].c_str());
+      bcf_hdr_remove(hdr_out, BCF_HL_INFO, tags.covered[t].c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.startFeature[t] + ",Number=.,Type=String,Description=\"Features of " + src + " near the SV start breakpoint, Format: name(distance|strand).\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.endFeature[t] + ",Number=.,Type=String,Description=\"Features of " + src + " near the SV end breakpoint, Format: name(distance|strand).\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.containedFeature[t] + ",Number=.,Type=String,Description=\"Features of " + src + " contained in the SV, Format: name(strand).\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.nfeatures[t] + ",Number=1,Type=Integer,Description=\"Number of features of " + src + " contained in the SV.\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.ncoding[t] + ",Number=1,Type=Integer,Description=\"Number of protein-coding features of " + src + " contained in the SV.\">").c_str());
+      bcf_hdr_append(hdr_out, ("##INFO=<ID=" + tags.covered[t] + ",Number=1,Type=Float,Description=\"Fraction of SV bases covered by features of " + src + ".\">").c_str());
+    }
+  }
+
+  // Scoring loop over the candidates of a query SV, specialized on the matching strategy and on bpwindow > 0
+  template<bool BestMatch, bool BpWindow, typename TConfig, typename TIterator>
+  inline void
+  _matchKernel(TConfig const& c, SV const& qsv, std::vector<TIterator> const& hits, DbMatch& m) {
+    for(uint32_t k = 0; k < hits.size(); ++k) {
+      TIterator itSV = hits[k];
+
+      // Any overlap?
+      float score = 0;
+      if ((itSV->svlen > 0) && (qsv.svlen > 0)) {
+	double rat = (double) itSV->svlen / (double) qsv.svlen;
+	if (qsv.svlen < itSV->svlen) rat = (double) qsv.svlen / (double) itSV->svlen;
+	if (rat < c.sizediff) continue;
+	score += rat;
+
+	// For intra-chromosomal SVs (no insertions, translocations, ...), check in addition reciprocal overlap
+	if ( ((qsv.svt < 4) || (qsv.svt > 8)) && ((itSV->svt < 4) || (itSV->svt > 8)) && (qsv.svEnd - qsv.svStart == qsv.svlen) && (itSV->svEnd - itSV->svStart == itSV->svlen)) {
+	  int32_t intersectionsize = std::min(itSV->svEnd, qsv.svEnd) - std::max(itSV->svStart, qsv.svStart);
+	  if (intersectionsize <= 0) continue;
+	  double recov = (double) intersectionsize / (double) qsv.svlen;
+	  if (recov < c.sizediff) continue;
+	  recov = (double) intersectionsize / (double) itSV->svlen;
+	  if (recov < c.sizediff) continue;
+	}
+      }
+
+      // Found match
+      m.noMatch = false;
+      if (BestMatch) {
+	if (BpWindow) {
+	  int32_t startDiff = std::abs(itSV->svStart - qsv.svStart);
+	  int32_t endDiff = std::abs(itSV->svEnd - qsv.svEnd);
+	  if (startDiff > endDiff) score += (1 - float(startDiff) / (float(c.bpwindow)));
+	  else score += (1 - float(endDiff) / (float(c.bpwindow)));
+	} else score += 1;
+	if (score > m.bestScore) {
+	  m.bestScore = score;
+	  m.bestID = itSV->id;
+	}
+      } else m.ids.push_back(itSV->id);
+    }
+  }
+
+  // Matches of a canonical query SV in one database
+  template<typename TConfig, typename TSV>
+  inline void
+  _matchDb(TConfig const& c, SV const& qsv, TSV const& svs, DbMatch& m) {
+    // Any breakpoint hit?
+    std::vector<typename TSV::const_iterator> hits;
+    svs.candidates(c, qsv, hits);
+    if (hits.empty()) return;
+    if (c.bestMatch) {
+      if (c.bpwindow > 0) _matchKernel<true, true>(c, qsv, hits, m);
+      else _matchKernel<true, false>(c, qsv, hits, m);
+    } else _matchKernel<false, false>(c, qsv, hits, m);
+  }
+
+  // Database matches and nearby features of a canonical query SV
+  template<typename TConfig, typename TSV>
+  inline void
+  _matchSV(TConfig const& c, SV const& qsv, std::vector<TSV> const& dbs, std::vector<FeatureTrack> const& tracks, SVMatch& m) {
+    // Annotate genes, without tracks a single set of NA feature columns is reported
+    m.features.resize(std::max<std::size_t>(tracks.size(), 1));
+    for(uint32_t t = 0; t < tracks.size(); ++t) {
+      FeatureTrack const& tr = tracks[t];
+      FeatureMatch& fm = m.features[t];
+      geneAnnotation(c, tr.gRegions, tr.gIndex, tr.geneIds, qsv.chr, qsv.svStart, qsv.chr2, qsv.svEnd, fm.featureBp1, fm.featureBp2, fm.featureContained);
+      if ((c.featureSummary) && (qsv.chr == qsv.chr2)) _containedSummary(tr.gRegions[qsv.chr], tr.gIndex[qsv.chr], tr.fs.chr[qsv.chr], tr.fs.pCoding, qsv.svStart, qsv.svEnd, fm.summary);
+    }
+    for(uint32_t t = 0; t < m.features.size(); ++t) {
+      FeatureMatch& fm = m.features[t];
+      if (fm.featureBp1.empty()) fm.featureBp1 = "NA";
+      if (fm.featureBp2.empty()) fm.featureBp2 = "NA";
+      if (fm.featureContained.empty()) fm.featureContained = "NA";
+    }
+
+    // Match all databases
+    m.dbs.resize(dbs.size());
+    for(uint32_t k = 0; k < dbs.size(); ++k) _matchDb(c, qsv, dbs[k], m.dbs[k]);
+  }
+
+  // ID and field columns of an additional database, the best match (strategy best) or all matches (strategy all)
+  // Field values of several matches are comma-separated within each column
+  template<typename TConfig, typename TSV>
+  inline void
+  _appendDbColumns(TConfig const& c, TSV const& svs, DbMatch const& m, uint32_t const nfields, std::string& out, std::string& annoIds, QueryBuffers& buf) {
+    std::vector<int32_t>& ids = buf.ids;
+    ids.clear();
+    if (c.bestMatch) {
+      if (m.bestID != -1) ids.push_back(m.bestID);
+    } else ids = m.ids;
+    for(uint32_t i = 0; i < ids.size(); ++i) {
+      if (i) annoIds += ',';
+      _appendAnnoId(annoIds, ids[i]);
+    }
+    out += '\t';
+    if (ids.empty()) out += "None";
+    else out += annoIds;
+    if (ids.size() < 2) {
+      svs.appendFields(out, ids.empty() ? -1 : ids[0]);
+      return;
+    }
+    std::vector<std::string>& cols = buf.cols;
+    std::string& row = buf.row;
+    cols.resize(nfields);
+    for(uint32_t f = 0; f < nfields; ++f) cols[f].clear();
+    for(uint32_t i = 0; i < ids.size(); ++i) {
+      row.clear();
+      svs.appendFields(row, ids[i]);
+      std::string_view rv(row);
+      for(uint32_t f = 0; f < nfields; ++f) {
+	rv.remove_prefix(1);
+	std::string_view val = rv.substr(0, rv.find('\t'));
+	rv.remove_prefix(val.size());
+	if (i) cols[f] += ',';
+	cols[f].append(val.data(), val.size());
+      }
+    }
+    for(uint32_t f = 0; f < nfields; ++f) {
+      out += '\t';
+      out += cols[f];
+    }
+  }
+
+  template<typename TConfig, typename TSV>
+  inline bool
+  _queryRecord(TConfig const& c, SVRecordDecoder const& dec, bcf_hdr_t* hdr_out, bcf1_t* rec, std::vector<int32_t> const& ridMap, std::vector<TSV> const& dbs, std::vector<FeatureTrack> const& tracks, std::vector<std::string> const& chrNames, QueryInfoTags const& tags, QueryMemo& memo, QueryBuffers& buf, std::string& rows) {
+    int32_t startsv = rec->pos + 1;
+    int32_t refIndex = ridMap[rec->rid];
+
+    // Decode SV
+    SVRecordFields f;
+    bool parsed = _decodeSVRecord(dec, rec, f);
+    if (!parsed) {
+      if (hdr_out != NULL) _annotateRecord(c, tags, hdr_out, rec, std::vector<std::string>(), std::vector<DbMatch>(), std::vector<FeatureMatch>(), buf.info);
+      return false;
+    }
+
+    // Generate query SV
+    SV qsv = SV(refIndex, startsv, _chrIndex(c.nchr, f.chr2Name), f.svEnd, 0, f.qual, f.svt, f.svlen);
+    _makeCanonical(qsv);
+
+    // Repeated SV keys reuse the previous match
+    SVKey key(qsv);
+    QueryMemo::TMatchPtr match = memo.find(key);
+    if (!match) {
+      std::shared_ptr<SVMatch> nm = std::make_shared<SVMatch>();
+      _matchSV(c, qsv, dbs, tracks, *nm);
+      match = nm;
+      memo.insert(key, match);
+    }
+    SVMatch const& m = *match;
+
+    // SVs with a match in any database are reported
+    bool anyMatch = false;
+    for(uint32_t k = 0; k < m.dbs.size(); ++k) {
+      if (!m.dbs[k].noMatch) anyMatch = true;
+    }
+
+    // Query columns shared by all output rows of this SV
+    std::string& qfields = buf.qfields;
+    qfields.clear();
+    if ((anyMatch) || (c.reportNoMatch)) {
+      qfields += '\t';
+      qfields += chrNames[rec->rid];
+      _appendInt(qfields, startsv);
+      qfields += '\t';
+      qfields += f.chr2Name;
+      qfields += '\t';
+      _appendInt(qfields, f.svEnd);
+      qfields += '\t';
+      qfields += rec->d.id;
+      qfields += '\t';
+      _appendInt(qfields, f.qual);
+      qfields += '\t';
+      qfields += _translateSvType(qsv.svt);
+      qfields += '\t';
+      qfields += _translateCt(qsv.svt);
+      qfields += '\t';
+      _appendInt(qfields, f.svlen);
+      for(uint32_t t = 0; t < m.features.size(); ++t) {
+	qfields += '\t';
+	qfields += m.features[t].featureBp1;
+	qfields += '\t';
+	qfields += m.features[t].featureBp2;
+	if (c.containedGenes) {
+	  qfields += '\t';
+	  qfields += m.features[t].featureContained;
+	}
+	if (c.featureSummary) _appendSummary(qfields, m.features[t].summary);
+      }
+    }
+
+    // Columns of additional databases follow the fields of the first database
+    std::vector<std::string>& annoIds = buf.annoIds;
+    annoIds.resize(m.dbs.size());
+    for(uint32_t k = 0; k < annoIds.size(); ++k) annoIds[k].clear();
+    std::string& dbfields = buf.dbfields;
+    dbfields.clear();
+    if ((anyMatch) || (c.reportNoMatch)) {
+      for(uint32_t k = 1; k < m.dbs.size(); ++k) _appendDbColumns(c, dbs[k], m.dbs[k], c.dbs[k].dbFields.size(), dbfields, annoIds[k], buf);
+    }
+
+    // One row per match of the first database
+    DbMatch const& m0 = m.dbs[0];
+    for(uint32_t k = 0; k < m0.ids.size(); ++k) {
+      _appendAnnoId(rows, m0.ids[k]);
+      rows += qfields;
+      dbs[0].appendFields(rows, m0.ids[k]);
+      rows += dbfields;
+      rows += '\n';
+      if (hdr_out != NULL) {
+	if (!annoIds[0].empty()) annoIds[0] += ',';
+	_appendAnnoId(annoIds[0], m0.ids[k]);
+      }
+    }
+    if (((c.bestMatch) && (m0.bestID != -1)) || ((m0.noMatch) && ((c.reportNoMatch) || (anyMatch)))) {
+      if (m0.noMatch) rows += "None";
+      else _appendAnnoId(rows, m0.bestID);
+      rows += qfields;
+      dbs[0].appendFields(rows, m0.bestID);
+      rows += dbfields;
+      rows += '\n';
+      if ((hdr_out != NULL) && (!m0.noMatch)) {
+	annoIds[0].clear();
+	_appendAnnoId(annoIds[0], m0.bestID);
+      }
+    }
+    if (hdr_out != NULL) _annotateRecord(c, tags, hdr_out, rec, annoIds, m.dbs, m.features, buf.info);
+    return true;
+  }
+
   
-  template<typename TConfig, typename TSV, typename TGenomicRegions, typename TGeneIds>
+  template<typename TConfig>
+  inline bool
+  _indexOutVcf(TConfig const& c) {
+    return ((c.outvcf.string() != "-") && (!c.uncompressed));
+  }
+
+  template<typename TConfig, typename TSV>
   inline bool
-  query(TConfig& c, TSV& svs, TGenomicRegions& gRegions, TGeneIds& geneIds) {
+  query(TConfig& c, htsFile* ifile, bcf_hdr_t* hdr, std::vector<TSV>& dbs, std::vector<FeatureTrack> const& tracks) {
 
     boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Query input SVs" << std::endl;
 
-    // Load bcf file
-    htsFile* ifile = bcf_open(c.infile.string().c_str(), "r");
-    if (ifile == NULL) {
-      std::cerr << "Fail to load " << c.infile.string() << std::endl;
+    // Query records are read from the open input, the caller closes it
+    SVRecordDecoder dec(hdr);
+
+    // Map header contigs to unified chromosome indices
+    std::vector<int32_t> ridMap(hdr->n[BCF_DT_CTG], 0);
+    for(int32_t rid = 0; rid < hdr->n[BCF_DT_CTG]; ++rid) ridMap[rid] = _chrIndex(c.nchr, std::string(bcf_hdr_id2name(hdr, rid)));
+    std::vector<std::string> chrNames;
+    _renderChrNames(hdr, chrNames);
+    QueryMemo memo(c.memoSize);
+
+    // Output file (BGZF or uncompressed, - is stdout)
+    BGZF* dataOut = bgzf_open(c.matchfile.string().c_str(), c.uncompressed ? "wu" : "w");
+    if (dataOut == NULL) {
+      std::cerr << "Fail to open output file " << c.matchfile.string() << std::endl;
       return false;
     }
-    bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+    _attachThreadPool(dataOut, c.tpool);
+    std::string header = "[1]ANNOID\tquery.chr\tquery.start\tquery.chr2\tquery.end\tquery.id\tquery.qual\tquery.svtype\tquery.ct\tquery.svlen";
+    for(uint32_t t = 0; t < std::max<std::size_t>(tracks.size(), 1); ++t) {
+      std::string sfx = _columnSuffix(t);
+      header += "\tquery.startfeature" + sfx + "\tquery.endfeature" + sfx;
+      if (c.containedGenes) header += "\tquery.containedfeature" + sfx;
+      if (c.featureSummary) header += "\tquery.nfeatures" + sfx + "\tquery.ncoding" + sfx + "\tquery.covered" + sfx;
+    }
+    for(uint32_t f = 0; f < c.dbs[0].dbFields.size(); ++f) header += "\tanno." + c.dbs[0].dbFields[f];
+    for(uint32_t k = 1; k < c.dbs.size(); ++k) {
+      std::string sfx = _columnSuffix(k);
+      header += "\tANNOID" + sfx;
+      for(uint32_t f = 0; f < c.dbs[k].dbFields.size(); ++f) header += "\tanno" + sfx + "." + c.dbs[k].dbFields[f];
+    }
+    header += '\n';
+    if (bgzf_write(dataOut, header.data(), header.size()) < 0) {
+      std::cerr << "Error writing " << c.matchfile.string() << std::endl;
+      return false;
+    }
+    RowBlockWriter rowWriter(dataOut);
+
+    // Optional annotated query BCF
+    QueryInfoTags tags;
+    tags.init(c);
+    htsFile* ofile = NULL;
+    bcf_hdr_t* hdr_out = NULL;
+    if (!c.outvcf.empty()) {
+      ofile = hts_open(c.outvcf.string().c_str(), c.uncompressed ? "wbu" : "wb");
+      if (ofile == NULL) {
+	std::cerr << "Fail to open output file " << c.outvcf.string() << std::endl;
+	return false;
+      }
+      _attachThreadPool(ofile, c.tpool);
+      hdr_out = bcf_hdr_dup(hdr);
+      _appendQueryInfoHeader(c, tags, hdr_out);
+      if (bcf_hdr_write(ofile, hdr_out) != 0) {
+	std::cerr << "Error: Failed to write BCF header!" << std::endl;
+	return false;
+      }
+
+      // Only a BGZF-compressed file can be indexed
+      if (_indexOutVcf(c)) {
+	std::string idxfile = c.outvcf.string() + ".csi";
+	if (bcf_idx_init(ofile, hdr_out, 14, idxfile.c_str()) != 0) {
+	  std::cerr << "Error: Failed to initialise BCF index!" << std::endl;
+	  return false;
+	}
+      }
+    }
 
-    // Output file
-    boost::iostreams::filtering_ostream dataOut;
-    dataOut.push(boost::iostreams::gzip_compressor());
-    dataOut.push(boost::iostreams::file_sink(c.matchfile.string().c_str(), std::ios_base::out | std::ios_base::binary));
-    dataOut << "[1]ANNOID\tquery.chr\tquery.start\tquery.chr2\tquery.end\tquery.id\tquery.qual\tquery.svtype\tquery.ct\tquery.svlen\tquery.startfeature\tquery.endfeature";
-    if (c.containedGenes) dataOut << "\tquery.containedfeature" << std::endl;
-    else dataOut << std::endl;
+#ifdef OPENMP
+    omp_set_num_threads(c.threads);
+#endif
     
-    // Parse VCF records
-    bcf1_t* rec = bcf_init();
+    // Parse VCF records in batches, annotate in parallel and write in input order
+    uint32_t batchSize = c.batchsize;
+    std::vector<bcf1_t*> batch(batchSize, NULL);
+    for(uint32_t i = 0; i < batchSize; ++i) batch[i] = bcf_init();
+    std::vector<std::string> rows(batchSize);
+    std::vector<char> parsed(batchSize, 0);
+    std::vector<QueryBuffers> buffers(std::max(c.threads, 1));
     int32_t parsedSV = 0;
     int32_t sitecount = 0;
-    int32_t lastRID = -1;
-    int32_t refIndex = -1;
-    while (bcf_read(ifile, hdr, rec) == 0) {
-      int32_t startsv = rec->pos + 1;
-      bool parsed = true;
-
-      // Count records
-      ++sitecount;
-
-      // New chromosome?
-      if (rec->rid != lastRID) {
-	lastRID = rec->rid;
-	std::string chrName = bcf_hdr_id2name(hdr, rec->rid);
-	refIndex = c.nchr[chrName];
+    bool carry = false;
+    uint32_t carryIdx = 0;
+    while (true) {
+      // A record that ended the previous batch starts the next one
+      uint32_t nrec = 0;
+      if (carry) {
+	std::swap(batch[0], batch[carryIdx]);
+	nrec = 1;
+	carry = false;
+      }
+      while ((nrec < batchSize) && (bcf_read(ifile, hdr, batch[nrec]) == 0)) {
+	for(uint32_t k = 0; (k < dbs.size()) && (!carry) && (nrec); ++k) carry = dbs[k].splitBatch(batch[0], batch[nrec]);
+	if (carry) {
+	  carryIdx = nrec;
+	  break;
+	}
+	++nrec;
+      }
+      if (nrec == 0) break;
+      for(uint32_t k = 0; k < dbs.size(); ++k) {
+	if (!dbs[k].prepare(c, c.dbs[k], ridMap, batch, nrec)) return false;
       }
       
-      // Unpack INFO
-      bcf_unpack(rec, BCF_UN_INFO);
-
-      // Parse INFO fields
-      std::string svtval = "NA";
-      if (!_parseSVTYPE(hdr, rec, svtval)) parsed = false;
-      std::string ctval("NA");
-      _parse_bcf_string(hdr, rec, "CT", ctval);
-      std::string chr2Name(bcf_hdr_id2name(hdr, rec->rid));
-      _parse_bcf_string(hdr, rec, "CHR2", chr2Name);
-      int32_t pos2val = -1;
-      _parse_bcf_int32(hdr, rec, "POS2", pos2val);
-      int32_t endval = -1;
-      _parse_bcf_int32(hdr, rec, "END", endval);
-      int32_t svlenval = 0;
-      _parse_bcf_int32(hdr, rec, "SVLEN", svlenval);
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+      for(uint32_t i = 0; i < nrec; ++i) {
+	uint32_t slot = 0;
+#ifdef OPENMP
+	slot = omp_get_thread_num();
+#endif
+	rows[i].clear();
+	parsed[i] = _queryRecord(c, dec, hdr_out, batch[i], ridMap, dbs, tracks, chrNames, tags, memo, buffers[slot], rows[i]);
+      }
       
-      // Derive proper END and SVLEN
-      int32_t endsv = deriveEndPos(rec, svtval, pos2val, endval);
-      bool parseALTBND = parseAltBnd(hdr, rec, svtval, ctval, chr2Name, endsv);
-      if (!parseALTBND) parsed = false;
-      int32_t svlength = deriveSvLength(rec, svtval, endsv, svlenval);
-
-      // Numerical SV type
-      int32_t svtint = _decodeOrientation(ctval, svtval);
-      if (svtint == -1) parsed = false;
-      int32_t qualval = 0;
-      if (rec->qual > 0) qualval = (int32_t) (rec->qual);
-      //std::cerr << parsed << "\t" << bcf_hdr_id2name(hdr, rec->rid) << "\t" << (rec->pos + 1) << "\t" << chr2Name << "\t" << endsv << "\t" << rec->d.id << "\t" << qualval << "\t" << svtval << "\t" << ctval << "\t" << svtint << "\t" << svlength << std::endl;
-
-      // Generate query SV
-      if (parsed) { 
-	SV qsv = SV(refIndex, startsv, c.nchr[chr2Name], endsv, 0, qualval, svtint, svlength);
-	_makeCanonical(qsv);
-            
-	// Annotate genes
-	std::string featureBp1 = "";
-	std::string featureBp2 = "";
-	std::string featureContained = "";
-	if (c.gtfFileFormat != -1) geneAnnotation(c, gRegions, geneIds, qsv.chr, qsv.svStart, qsv.chr2, qsv.svEnd, featureBp1, featureBp2, featureContained);
-	if (featureBp1.empty()) featureBp1 = "NA";
-	if (featureBp2.empty()) featureBp2 = "NA";
-	if (featureContained.empty()) featureContained = "NA";
-
-	// Any breakpoint hit?
-	typename TSV::iterator itSV = std::lower_bound(svs.begin(), svs.end(), SV(qsv.chr, std::max(0, qsv.svStart - c.bpwindow), qsv.chr2, qsv.svEnd));
-	int32_t bestID = -1;
-	float bestScore = -1;
-	bool noMatch = true;
-	for(; itSV != svs.end(); ++itSV) {
-	  int32_t startDiff = std::abs(itSV->svStart - qsv.svStart);
-	  if (startDiff > c.bpwindow) break;
-	  if (itSV->chr2 != qsv.chr2) continue;
-	  if ((c.matchSvType) && (itSV->svt != qsv.svt)) continue;
-	  int32_t endDiff = std::abs(itSV->svEnd - qsv.svEnd);
-	  if (endDiff > c.bpwindow) continue;
-	  if (itSV->id == -1) continue;
-
-	  //std::cerr << qsv.svStart << ',' << qsv.svEnd << ',' << qsv.svlen << ',' << qsv.svt << '\t' << itSV->svStart << ',' << itSV->svEnd << ',' << itSV->svlen << ',' << itSV->svt << std::endl;
-	  
-	  // Any overlap?
-	  float score = 0;
-	  if ((itSV->svlen > 0) && (qsv.svlen > 0)) {
-	    double rat = (double) itSV->svlen / (double) qsv.svlen;
-	    if (qsv.svlen < itSV->svlen) rat = (double) qsv.svlen / (double) itSV->svlen;
-	    if (rat < c.sizediff) continue;
-	    score += rat;
-
-	    // For intra-chromosomal SVs (no insertions, translocations, ...), check in addition reciprocal overlap
-	    if ( ((qsv.svt < 4) || (qsv.svt > 8)) && ((itSV->svt < 4) || (itSV->svt > 8)) && (qsv.svEnd - qsv.svStart == qsv.svlen) && (itSV->svEnd - itSV->svStart == itSV->svlen)) {
-	      if (itSV->svEnd < qsv.svStart) continue;
-	      if (qsv.svEnd < itSV->svStart) continue;
-	      std::vector<int32_t> posarr;
-	      posarr.push_back(itSV->svStart);
-	      posarr.push_back(itSV->svEnd);
-	      posarr.push_back(qsv.svStart);
-	      posarr.push_back(qsv.svEnd);
-	      std::sort(posarr.begin(), posarr.end());
-	      int32_t intersectionsize = posarr[2] - posarr[1];
-	      if (intersectionsize <= 0) continue;
-	      double recov = (double) intersectionsize / (double) qsv.svlen;
-	      if (recov < c.sizediff) continue;
-	      recov = (double) intersectionsize / (double) itSV->svlen;
-	      if (recov < c.sizediff) continue;
-	    }	      
-	  }
-	
-	  // Found match
-	  noMatch = false;
-	  if (c.bestMatch) {
-	    if (c.bpwindow > 0) {
-	      if (startDiff > endDiff) score += (1 - float(startDiff) / (float(c.bpwindow)));
-	      else score += (1 - float(endDiff) / (float(c.bpwindow)));
-	    } else score += 1;
-	    if (score > bestScore) {
-	      bestScore = score;
-	      bestID = itSV->id;
-	    }
-	  } else {
-	    std::string id("id");
-	    std::string padNumber = boost::lexical_cast<std::string>(itSV->id);
-	    padNumber.insert(padNumber.begin(), 9 - padNumber.length(), '0');
-	    id += padNumber;
-	    dataOut << id << '\t' << bcf_hdr_id2name(hdr, rec->rid) << '\t' << startsv << '\t' << chr2Name << '\t' <<  endsv << '\t' << rec->d.id << '\t' << qualval << '\t' << _translateSvType(qsv.svt) << '\t' << _translateCt(qsv.svt) << '\t' << svlength << '\t' << featureBp1 << '\t' << featureBp2;
-	    if (c.containedGenes) dataOut << '\t' << featureContained << std::endl;
-	    else dataOut << std::endl;
+      // Ordered output
+      for(uint32_t i = 0; i < nrec; ++i) {
+	++sitecount;
+	if (parsed[i]) {
+	  if (!rowWriter.append(rows[i])) {
+	    std::cerr << "Error writing " << c.matchfile.string() << std::endl;
+	    return false;
 	  }
+	  ++parsedSV;
 	}
-	if (((c.bestMatch) && (bestID != -1)) || ((c.reportNoMatch) && (noMatch))) {
-	  std::string id("id");
-	  if (noMatch) {
-	    id = "None";
-	  } else {
-	    std::string padNumber = boost::lexical_cast<std::string>(bestID);
-	    padNumber.insert(padNumber.begin(), 9 - padNumber.length(), '0');
-	    id += padNumber;
-	  }
-	  dataOut << id << '\t' << bcf_hdr_id2name(hdr, rec->rid) << '\t' << startsv << '\t' << chr2Name << '\t' << endsv << '\t' << rec->d.id << '\t' << qualval << '\t' << _translateSvType(qsv.svt) << '\t' << _translateCt(qsv.svt) << '\t' << svlength << '\t' << featureBp1 << '\t' << featureBp2;
-	  if (c.containedGenes) dataOut << '\t' << featureContained << std::endl;
-	  else dataOut << std::endl;
+	if ((ofile != NULL) && (bcf_write1(ofile, hdr_out, batch[i]) < 0)) {
+	  std::cerr << "Error writing " << c.outvcf.string() << std::endl;
+	  return false;
 	}
-
-	// Successful parse
-	++parsedSV;
       }
+      if ((nrec < batchSize) && (!carry)) break;
+    }
+    for(uint32_t i = 0; i < batchSize; ++i) bcf_destroy(batch[i]);
+    if (!rowWriter.flush()) {
+      std::cerr << "Error writing " << c.matchfile.string() << std::endl;
+      return false;
     }
-    bcf_destroy(rec);
 
     // Statistics
     now = boost::posix_time::second_clock::local_time();
     std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Parsed " << parsedSV << " out of " << sitecount << " VCF/BCF records." << std::endl;
+    memo.statistics();
 	
     // Close file handles
-    dataOut.pop();
-    dataOut.pop();
+    bgzf_close(dataOut);
 
-    bcf_hdr_destroy(hdr);
-    bcf_close(ifile);
+    if (ofile != NULL) {
+      if ((_indexOutVcf(c)) && (bcf_idx_save(ofile) != 0)) std::cerr << "Error: Failed to save BCF index!" << std::endl;
+      bcf_hdr_destroy(hdr_out);
+      if (hts_close(ofile) != 0) {
+	std::cerr << "Error writing " << c.outvcf.string() << std::endl;
+	return false;
+      }
+    }
+
+    // Tabix index on query.chr and query.start
+    if (c.tabix) {
+      now = boost::posix_time::second_clock::local_time();
+      std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Index query SVs" << std::endl;
+      tbx_conf_t conf = tbx_conf_gff;
+      conf.preset = TBX_GENERIC;
+      conf.sc = 2;
+      conf.bc = 3;
+      conf.ec = 3;
+      conf.meta_char = '#';
+      conf.line_skip = 1;
+      if (tbx_index_build(c.matchfile.string().c_str(), 0, &conf) != 0) std::cerr << "Warning: Failed to build tabix index, is the input VCF/BCF file sorted?" << std::endl;
+    }
 
     return true;
   }
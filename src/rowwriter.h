@@ -0,0 +1,78 @@
+#ifndef ROWWRITER_H
+#define ROWWRITER_H
+
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include <htslib/bgzf.h>
+#include <htslib/vcf.h>
+
+namespace sansa
+{
+
+  // Output rows are collected and handed to the compressor in blocks of this size
+  #define SANSA_ROW_BLOCK 4194304
+
+  inline void
+  _appendInt(std::string& out, int64_t const val) {
+    char buf[24];
+    std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), val);
+    out.append(buf, res.ptr - buf);
+  }
+
+  // ANNOID of a database SV, "id" followed by the zero-padded 9-digit SV id
+  inline void
+  _appendAnnoId(std::string& out, int32_t const id) {
+    char buf[16];
+    std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), id);
+    std::size_t len = res.ptr - buf;
+    out += "id";
+    if (len < 9) out.append(9 - len, '0');
+    out.append(buf, len);
+  }
+
+  // Column and INFO tag suffix of the t-th annotation source, the first source keeps the plain names
+  inline std::string
+  _columnSuffix(uint32_t const t) {
+    std::string sfx;
+    if (t) _appendInt(sfx, t + 1);
+    return sfx;
+  }
+
+  // Tab-terminated chromosome names of a VCF/BCF header
+  inline void
+  _renderChrNames(bcf_hdr_t const* hdr, std::vector<std::string>& chrNames) {
+    chrNames.resize(hdr->n[BCF_DT_CTG]);
+    for(int32_t rid = 0; rid < hdr->n[BCF_DT_CTG]; ++rid) {
+      chrNames[rid] = bcf_hdr_id2name(hdr, rid);
+      chrNames[rid] += '\t';
+    }
+  }
+
+  // Buffered writer of formatted rows into a BGZF file
+  struct RowBlockWriter {
+    BGZF* fp;
+    std::string block;
+
+    explicit RowBlockWriter(BGZF* f) : fp(f) {
+      block.reserve(SANSA_ROW_BLOCK + 65536);
+    }
+
+    bool append(std::string const& rows) {
+      block += rows;
+      if (block.size() >= SANSA_ROW_BLOCK) return flush();
+      return true;
+    }
+
+    bool flush() {
+      if (block.empty()) return true;
+      bool ok = (bgzf_write(fp, block.data(), block.size()) >= 0);
+      block.clear();
+      return ok;
+    }
+  };
+
+}
+
+#endif
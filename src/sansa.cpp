@@ -12,6 +12,8 @@
 #include "util.h"
 #include "version.h"
 #include "annotate.h"
+#include "dbindex.h"
+#include "featureindex.h"
 #include "compvcf.h"
 #include "markdup.h"
 
@@ -24,6 +26,8 @@ displayUsage() {
   std::cerr << "Commands:" << std::endl;
   std::cerr << std::endl;
   std::cerr << "    annotate     annotate VCF file" << std::endl;
+  std::cerr << "    dbindex      build binary SV annotation database" << std::endl;
+  std::cerr << "    featureindex build binary GTF/GFF3/BED feature index" << std::endl;
   std::cerr << "    markdup      mark duplicate SV sites based on SV allele and GT concordance" << std::endl;
   std::cerr << "    compvcf      compare multi-sample VCF to a ground truth VCF" << std::endl;
   std::cerr << std::endl;
@@ -59,6 +63,12 @@ int main(int argc, char **argv) {
   else if ((std::string(argv[1]) == "annotate")) {
     return annotate(argc-1,argv+1);
   }
+  else if ((std::string(argv[1]) == "dbindex")) {
+    return dbindex(argc-1,argv+1);
+  }
+  else if ((std::string(argv[1]) == "featureindex")) {
+    return featureindex(argc-1,argv+1);
+  }
   else if ((std::string(argv[1]) == "markdup")) {
     return markdup(argc-1,argv+1);
   }
@@ -0,0 +1,856 @@
+#define _SECURE_SCL 0
+#define _SCL_SECURE_NO_WARNINGS
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+#define BOOST_DISABLE_ASSERTS
+
+#include <boost/filesystem.hpp>
+#include <boost/tokenizer.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <htslib/vcf.h>
+
+#include "util.h"
+#include "version.h"
+#include "svfilter.h"
+#include "decoder.h"
+#include "gtf.h"
+#include "svdb.h"
+#include "query.h"
+
+using namespace sansa;
+
+// Microbenchmarks on synthetic data, each compares an optimized code path against a reference implementation and checks that both agree
+
+struct BenchConfig {
+  bool matchSvType;
+  bool bestMatch;
+  int32_t bpwindow;
+  float sizediff;
+};
+
+typedef std::chrono::steady_clock TBenchClock;
+
+inline double
+_benchMs(TBenchClock::time_point const& t0, TBenchClock::time_point const& t1) {
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// Sorted synthetic database, a share of the SVs (hotspot in percent) starts in 5 clusters of hotspotWidth bp per chromosome
+inline void
+_syntheticDb(std::mt19937& rng, uint32_t const nsv, int32_t const nchr, int32_t const chrLen, int32_t const hotspot, int32_t const hotspotWidth, int32_t const maxLen, std::vector<SV>& svs) {
+  svs.clear();
+  for(uint32_t i = 0; i < nsv; ++i) {
+    int32_t chr = rng() % nchr;
+    int32_t start = rng() % chrLen;
+    if ((int32_t) (rng() % 100) < hotspot) start = (chrLen / 6) * (1 + rng() % 5) + rng() % hotspotWidth;
+    int32_t len = 50 + rng() % maxLen;
+    int32_t chr2 = chr;
+    if ((nchr > 1) && (rng() % 10 == 0)) chr2 = rng() % nchr;
+    if (chr2 == chr) svs.push_back(SV(chr, start, chr2, start + len, i, 0, rng() % 4, len));
+    else svs.push_back(SV(std::max(chr, chr2), start, std::min(chr, chr2), rng() % chrLen, i, 0, 5 + rng() % 4, -1));
+  }
+  std::sort(svs.begin(), svs.end());
+}
+
+// Queries are database SVs with both breakpoints moved by up to jitter bp
+inline void
+_syntheticQueries(std::mt19937& rng, std::vector<SV> const& svs, uint32_t const nq, int32_t const jitter, std::vector<SV>& qsvs) {
+  qsvs.clear();
+  for(uint32_t i = 0; i < nq; ++i) {
+    SV qsv = svs[rng() % svs.size()];
+    qsv.svStart = std::max(0, qsv.svStart + (int32_t) (rng() % (2 * jitter + 1)) - jitter);
+    qsv.svEnd += (int32_t) (rng() % (2 * jitter + 1)) - jitter;
+    if (qsv.chr == qsv.chr2) qsv.svlen = std::max(1, qsv.svEnd - qsv.svStart);
+    qsvs.push_back(qsv);
+  }
+}
+
+// Window scan over the sorted array with the grid's conservative size ratio check, the candidate search before the breakpoint grid
+template<typename TConfig>
+inline void
+_scanCandidates(TConfig const& c, SV const* first, SV const* last, SV const& qsv, std::vector<SV const*>& hits) {
+  _windowCandidates(c, first, last, qsv, hits);
+  float qlen = qsv.svlen;
+  uint32_t k = 0;
+  for(uint32_t i = 0; i < hits.size(); ++i) {
+    float len = hits[i]->svlen;
+    if ((len > 0) && (qlen > 0) && (std::min(len, qlen) < 0.999f * c.sizediff * std::max(len, qlen))) continue;
+    hits[k++] = hits[i];
+  }
+  hits.resize(k);
+}
+
+// Grid lookup with a scalar loop over the cell columns
+template<typename TConfig>
+inline void
+_scalarGridCandidates(TConfig const& c, BreakpointGrid const& grid, SV const* first, SV const& qsv, std::vector<SV const*>& hits) {
+  hits.clear();
+  GridQuery q;
+  q.svStart = qsv.svStart;
+  q.svEnd = qsv.svEnd;
+  q.bpwindow = c.bpwindow;
+  q.svlen = qsv.svlen;
+  q.ratio = 0.999f * c.sizediff;
+  GridCell g = grid.key(qsv);
+  for(g.start = grid.cell(qsv.svStart - c.bpwindow); g.start <= grid.cell(qsv.svStart + c.bpwindow); ++g.start) {
+    for(g.end = grid.cell(qsv.svEnd - c.bpwindow); g.end <= grid.cell(qsv.svEnd + c.bpwindow); ++g.end) {
+      GridSlot const* slot = grid.find(g);
+      if (slot == NULL) continue;
+      for(uint32_t i = slot->begin; i < slot->end; ++i) {
+	if (_gridCandidate(grid.entries, i, q)) hits.push_back(first + grid.entries.pos[i]);
+      }
+    }
+  }
+  std::sort(hits.begin(), hits.end());
+}
+
+inline bool
+_gridScenario(std::string const& name, uint32_t const nsv, int32_t const nchr, int32_t const chrLen, int32_t const hotspot, int32_t const hotspotWidth, int32_t const maxLen, int32_t const bpwindow) {
+  BenchConfig c;
+  c.matchSvType = true;
+  c.bestMatch = true;
+  c.bpwindow = bpwindow;
+  c.sizediff = 0.8;
+  std::mt19937 rng(7);
+  std::vector<SV> svs;
+  _syntheticDb(rng, nsv, nchr, chrLen, hotspot, hotspotWidth, maxLen, svs);
+  std::vector<SV> qsvs;
+  _syntheticQueries(rng, svs, 200000, bpwindow, qsvs);
+  SV const* first = &svs[0];
+  SV const* last = first + svs.size();
+  BreakpointGrid grid;
+  TBenchClock::time_point t0 = TBenchClock::now();
+  grid.build(c, first, last);
+  double tBuild = _benchMs(t0, TBenchClock::now());
+
+  // Best of 3 runs
+  std::vector<SV const*> hits;
+  double tScan = 1e12;
+  double tScalar = 1e12;
+  double tGrid = 1e12;
+  uint64_t nhits = 0;
+  for(uint32_t run = 0; run < 3; ++run) {
+    nhits = 0;
+    t0 = TBenchClock::now();
+    for(uint32_t i = 0; i < qsvs.size(); ++i) {
+      _scanCandidates(c, first, last, qsvs[i], hits);
+      nhits += hits.size();
+    }
+    TBenchClock::time_point t1 = TBenchClock::now();
+    for(uint32_t i = 0; i < qsvs.size(); ++i) {
+      _scalarGridCandidates(c, grid, first, qsvs[i], hits);
+      nhits -= hits.size();
+    }
+    TBenchClock::time_point t2 = TBenchClock::now();
+    for(uint32_t i = 0; i < qsvs.size(); ++i) {
+      grid.candidates(c, first, qsvs[i], hits);
+      nhits += hits.size();
+    }
+    TBenchClock::time_point t3 = TBenchClock::now();
+    tScan = std::min(tScan, _benchMs(t0, t1));
+    tScalar = std::min(tScalar, _benchMs(t1, t2));
+    tGrid = std::min(tGrid, _benchMs(t2, t3));
+  }
+
+  // Identical hit lists
+  std::vector<SV const*> ref;
+  std::vector<SV const*> scalar;
+  for(uint32_t i = 0; i < qsvs.size(); ++i) {
+    _scanCandidates(c, first, last, qsvs[i], ref);
+    _scalarGridCandidates(c, grid, first, qsvs[i], scalar);
+    grid.candidates(c, first, qsvs[i], hits);
+    if ((ref != scalar) || (ref != hits)) {
+      std::cout << name << ": candidates differ for query " << i << std::endl;
+      return false;
+    }
+  }
+  std::cout << name << "\tbuild " << tBuild << " ms\tscan " << tScan << " ms\tgrid (scalar cells) " << tScalar << " ms\tgrid (SSE2 cells) " << tGrid << " ms\thits " << nhits << std::endl;
+  return true;
+}
+
+// Candidate search: window scan vs. breakpoint grid with scalar and SIMD cell filters
+inline int
+benchGrid() {
+  std::cout << "Candidate search, 200k jittered queries, best of 3 runs" << std::endl;
+  bool ok = true;
+  ok &= _gridScenario("uniform, 400k SVs, -b 50", 400000, 24, 200000000, 0, 200, 20000, 50);
+  ok &= _gridScenario("50% in 200bp hotspots, 400k SVs, -b 50", 400000, 24, 200000000, 50, 200, 20000, 50);
+  ok &= _gridScenario("90% in 200bp hotspots, 400k SVs, -b 50", 400000, 24, 200000000, 90, 200, 20000, 50);
+  ok &= _gridScenario("2M SVs in 2Mbp, -b 500", 2000000, 1, 2000000, 0, 1, 5000, 500);
+  return ok ? 0 : 1;
+}
+
+// Search start of the window scan before the boundary fix, SVs at exactly svStart - bpwindow with a smaller svEnd were skipped
+inline SV const*
+_oldWindowStart(BenchConfig const& c, SV const* first, SV const* last, SV const& qsv) {
+  return std::lower_bound(first, last, SV(qsv.chr, std::max(0, qsv.svStart - c.bpwindow), qsv.chr2, qsv.svEnd));
+}
+
+// Window boundary check: a database SV starting exactly bpwindow before the query with a smaller end
+inline int
+checkBoundary() {
+  BenchConfig c;
+  c.matchSvType = true;
+  c.bestMatch = true;
+  c.bpwindow = 50;
+  c.sizediff = 0.8;
+  std::vector<SV> svs;
+  svs.push_back(SV(0, 100, 0, 500, 0, 0, 0, 400));
+  svs.push_back(SV(1, 100, 0, 500, 1, 0, 5, -1));
+  std::sort(svs.begin(), svs.end());
+  SV const* first = &svs[0];
+  SV const* last = first + svs.size();
+  BreakpointGrid grid;
+  grid.build(c, first, last);
+  ChrPairIndex pairIndex;
+  pairIndex.build(first, last);
+  std::vector<SV> qsvs;
+  qsvs.push_back(SV(0, 150, 0, 520, 0, 0, 0, 370));
+  qsvs.push_back(SV(1, 150, 0, 520, 0, 0, 5, -1));
+  bool ok = true;
+  std::vector<SV const*> hits;
+  for(uint32_t i = 0; i < qsvs.size(); ++i) {
+    SV const& qsv = qsvs[i];
+    SV const* itSV = _oldWindowStart(c, first, last, qsv);
+    bool oldHit = ((itSV != last) && (itSV->chr == qsv.chr) && (std::abs(itSV->svStart - qsv.svStart) <= c.bpwindow) && (itSV->chr2 == qsv.chr2) && (std::abs(itSV->svEnd - qsv.svEnd) <= c.bpwindow));
+    _windowCandidates(c, first, last, qsv, hits);
+    bool scanHit = (hits.size() == 1);
+    if (qsv.chr == qsv.chr2) grid.candidates(c, first, qsv, hits);
+    else pairIndex.candidates(c, first, qsv, hits);
+    bool indexHit = (hits.size() == 1);
+    std::cout << "Query " << qsv.chr << ":" << qsv.svStart << " - " << qsv.chr2 << ":" << qsv.svEnd << ", database SV " << svs[i].chr << ":" << svs[i].svStart << " - " << svs[i].chr2 << ":" << svs[i].svEnd << ", -b " << c.bpwindow << std::endl;
+    std::cout << "  old window scan: " << (oldHit ? "found" : "missed") << "\twindow scan: " << (scanHit ? "found" : "missed") << "\t" << ((qsv.chr == qsv.chr2) ? "grid" : "chromosome pair index") << ": " << (indexHit ? "found" : "missed") << std::endl;
+    if ((oldHit) || (!scanHit) || (!indexHit)) ok = false;
+  }
+  return ok ? 0 : 1;
+}
+
+// Per-record INFO lookups of the SV decoding before SVRecordDecoder, each value is looked up by name and copied into a malloc'ed buffer
+inline bool
+_refInfoString(bcf_hdr_t* hdr, bcf1_t* rec, std::string const& key, std::string& strval) {
+  if (_isKeyPresent(hdr, key)) {
+    char* val = NULL;
+    int32_t nval = 0;
+    if (bcf_get_info_string(hdr, rec, key.c_str(), &val, &nval) > 0) strval = std::string(val);
+    else {
+      if (val != NULL) free(val);
+      return false;
+    }
+    if (val != NULL) free(val);
+  } else return false;
+  return true;
+}
+
+inline bool
+_refInfoInt32(bcf_hdr_t* hdr, bcf1_t* rec, std::string const& key, int32_t& intval) {
+  if (_isKeyPresent(hdr, key)) {
+    int32_t nval = 0;
+    int32_t* val = NULL;
+    if (bcf_get_info_int32(hdr, rec, key.c_str(), &val, &nval) > 0) intval = *val;
+    else {
+      if (val != NULL) free(val);
+      return false;
+    }
+    if (val != NULL) free(val);
+  } else return false;
+  return true;
+}
+
+inline bool
+_refAltBnd(bcf_hdr_t* hdr, bcf1_t* rec, SVRecordFields& f, int32_t& endval) {
+  if (endval != -1) return true;
+  if (f.svtval != "BND") return false;
+  std::string altAllele = rec->d.allele[1];
+  std::size_t found1 = altAllele.find_first_of("[");
+  std::size_t found2 = altAllele.find_last_of("[");
+  if ((found1 == std::string::npos) && (found2 == std::string::npos)) {
+    found1 = altAllele.find_first_of("]");
+    found2 = altAllele.find_last_of("]");
+  }
+  if ((found1 == std::string::npos) || (found2 == std::string::npos)) return false;
+  if (found1 + 1 >= found2) return false;
+  altAllele = altAllele.substr(found1 + 1, found2 - found1 - 1);
+  std::size_t sepa = altAllele.find_first_of(":");
+  if (sepa == std::string::npos) return false;
+  f.chr2Name = altAllele.substr(0, sepa);
+  endval = boost::lexical_cast<int32_t>(altAllele.substr(sepa+1));
+  std::string chr1Name = bcf_hdr_id2name(hdr, rec->rid);
+  if (chr1Name == f.chr2Name) {
+    int32_t pos = rec->pos + 1;
+    if (pos > endval) return false;
+    std::string svclass = "NA";
+    if (_refInfoString(hdr, rec, "SVCLASS", svclass)) {
+      if (svclass == "DEL") {
+	f.svtval = "DEL";
+	f.ctval = "3to5";
+      } else if (svclass == "DUP") {
+	f.svtval = "DUP";
+	f.ctval = "5to3";
+      } else if (svclass == "h2hINV") {
+	f.svtval = "INV";
+	f.ctval = "3to3";
+      } else if (svclass == "t2tINV") {
+	f.svtval = "INV";
+	f.ctval = "5to5";
+      } else if (svclass == "INS") {
+	f.svtval = "INS";
+	f.ctval = "NtoN";
+	endval = rec->pos + 2;
+      }
+    }
+    if (f.svtval == "BND") {
+      if (f.ctval == "3to5") f.svtval = "DEL";
+      else if (f.ctval == "5to3") f.svtval = "DUP";
+      else if (f.ctval == "3to3") f.svtval = "INV";
+      else if (f.ctval == "5to5") f.svtval = "INV";
+      else if (f.ctval == "NtoN") f.svtval = "INS";
+      else return false;
+    }
+  }
+  return true;
+}
+
+inline int32_t
+_refOrientation(std::string const& value, std::string const& svt) {
+  if ((svt == "BND") || (svt == "TRA")) {
+    if (value=="NA") return DELLY_SVT_TRANS + 0;
+    else if (value=="3to3") return DELLY_SVT_TRANS + 0;
+    else if (value=="5to5") return DELLY_SVT_TRANS + 1;
+    else if (value=="3to5") return DELLY_SVT_TRANS + 2;
+    else if (value=="5to3") return DELLY_SVT_TRANS + 3;
+    else return -1;
+  } else {
+    if (value=="NA") {
+      if (svt == "DEL") return 2;
+      else if (svt == "INV") return 0;
+      else if (svt == "DUP") return 3;
+      else if (svt == "INS") return 4;
+      else if (svt == "CNV") return 9;
+      else if (svt == "CPX") return 10;
+      else if (svt == "CTX") return 11;
+      else if (svt == "SCNA") return 12;
+      else if (svt == "MCNV") return 13;
+      else return -1;
+    }
+    else if (value=="3to3") return 0;
+    else if (value=="5to5") return 1;
+    else if (value=="3to5") return 2;
+    else if (value=="5to3") return 3;
+    else return 4;
+  }
+}
+
+inline bool
+_refDecodeSVRecord(bcf_hdr_t* hdr, bcf1_t* rec, SVRecordFields& f) {
+  bool parsed = true;
+  bcf_unpack(rec, BCF_UN_INFO);
+  f.svtval = "NA";
+  if (!_refInfoString(hdr, rec, "SVTYPE", f.svtval)) {
+    std::string altAllele = rec->d.allele[1];
+    if ((altAllele.size() > 2) && (altAllele[0] == '<') && (altAllele[altAllele.size() - 1] == '>')) f.svtval = altAllele.substr(1, altAllele.size() - 2);
+    else parsed = false;
+  }
+  f.ctval = "NA";
+  f.hasCT = _refInfoString(hdr, rec, "CT", f.ctval);
+  f.chr2Name = bcf_hdr_id2name(hdr, rec->rid);
+  _refInfoString(hdr, rec, "CHR2", f.chr2Name);
+  int32_t pos2val = -1;
+  _refInfoInt32(hdr, rec, "POS2", pos2val);
+  int32_t endval = -1;
+  _refInfoInt32(hdr, rec, "END", endval);
+  int32_t svlenval = 0;
+  _refInfoInt32(hdr, rec, "SVLEN", svlenval);
+  f.svEnd = deriveEndPos(rec, f.svtval, pos2val, endval);
+  if (!_refAltBnd(hdr, rec, f, f.svEnd)) parsed = false;
+  f.svlen = deriveSvLength(rec, f.svtval, f.svEnd, svlenval);
+  f.svt = _refOrientation(f.ctval, f.svtval);
+  if (f.svt == -1) parsed = false;
+  f.qual = 0;
+  if (rec->qual > 0) f.qual = (int32_t) (rec->qual);
+  return parsed;
+}
+
+inline bool
+_sameFields(SVRecordFields const& a, SVRecordFields const& b) {
+  return ((a.svtval == b.svtval) && (a.ctval == b.ctval) && (a.chr2Name == b.chr2Name) && (a.svEnd == b.svEnd) && (a.svlen == b.svlen) && (a.svt == b.svt) && (a.qual == b.qual) && (a.hasCT == b.hasCT));
+}
+
+// Synthetic Delly-style SV sites: symbolic DEL/DUP/INV/INS, translocations with CHR2/POS2 and intra-chromosomal BND alleles with SVCLASS
+inline void
+_syntheticVcf(std::mt19937& rng, uint32_t const nrec, boost::filesystem::path const& path) {
+  static char const* const cts[4] = {"3to3", "5to5", "3to5", "5to3"};
+  static char const* const svclass[5] = {"DEL", "DUP", "h2hINV", "t2tINV", "INS"};
+  std::ofstream vcf(path.string().c_str());
+  vcf << "##fileformat=VCFv4.2" << std::endl;
+  for(int32_t k = 1; k <= 4; ++k) vcf << "##contig=<ID=chr" << k << ",length=200000000>" << std::endl;
+  vcf << "##INFO=<ID=PRECISE,Number=0,Type=Flag,Description=\"Precise structural variant\">" << std::endl;
+  vcf << "##INFO=<ID=SVTYPE,Number=1,Type=String,Description=\"Type of structural variant\">" << std::endl;
+  vcf << "##INFO=<ID=SVCLASS,Number=1,Type=String,Description=\"Class of the breakend\">" << std::endl;
+  vcf << "##INFO=<ID=CT,Number=1,Type=String,Description=\"Paired-end signature induced connection type\">" << std::endl;
+  vcf << "##INFO=<ID=CHR2,Number=1,Type=String,Description=\"Chromosome for POS2 coordinate in case of an inter-chromosomal translocation\">" << std::endl;
+  vcf << "##INFO=<ID=POS2,Number=1,Type=Integer,Description=\"Genomic position for CHR2 in case of an inter-chromosomal translocation\">" << std::endl;
+  vcf << "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position of the structural variant\">" << std::endl;
+  vcf << "##INFO=<ID=SVLEN,Number=1,Type=Integer,Description=\"Length of the SV\">" << std::endl;
+  vcf << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO" << std::endl;
+  for(uint32_t i = 0; i < nrec; ++i) {
+    int32_t chr = 1 + rng() % 4;
+    int32_t pos = 1 + rng() % 100000000;
+    int32_t len = 50 + rng() % 100000;
+    vcf << "chr" << chr << '\t' << pos << "\tSV" << i << "\tN\t";
+    switch (i % 6) {
+    case 0:
+      vcf << "<DEL>\t" << rng() % 1000 << "\tPASS\tPRECISE;SVTYPE=DEL;END=" << pos + len << ";SVLEN=-" << len << ";CT=3to5";
+      break;
+    case 1:
+      vcf << "<DUP>\t" << rng() % 1000 << "\tPASS\tSVTYPE=DUP;END=" << pos + len << ";CT=5to3";
+      break;
+    case 2:
+      vcf << "<INV>\t" << rng() % 1000 << "\tPASS\tSVTYPE=INV;END=" << pos + len << ";CT=" << cts[rng() % 2];
+      break;
+    case 3:
+      vcf << "<INS>\t.\tPASS\t" << ((i % 12 == 3) ? "" : "SVTYPE=INS;") << "END=" << pos + 1 << ";SVLEN=" << len;
+      break;
+    case 4:
+      vcf << "N[chr" << 1 + (chr % 4) << ':' << len << "[\t" << rng() % 1000 << "\tPASS\tSVTYPE=BND;CHR2=chr" << 1 + (chr % 4) << ";POS2=" << len << ";CT=" << cts[rng() % 4];
+      break;
+    default:
+      vcf << "N[chr" << chr << ':' << pos + len << "[\t" << rng() % 1000 << "\tPASS\tSVTYPE=BND;SVCLASS=" << svclass[rng() % 5];
+      break;
+    }
+    vcf << std::endl;
+  }
+}
+
+// Record decoding: SVRecordDecoder vs. per-record INFO lookups by name
+inline int
+benchDecode() {
+  uint32_t const nrec = 600000;
+  std::mt19937 rng(11);
+  boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sansabench-%%%%-%%%%.vcf");
+  _syntheticVcf(rng, nrec, path);
+  htsFile* ifile = hts_open(path.string().c_str(), "r");
+  if (ifile == NULL) {
+    std::cerr << "Fail to open " << path.string() << std::endl;
+    return 1;
+  }
+  bcf_hdr_t* hdr = bcf_hdr_read(ifile);
+  std::vector<bcf1_t*> recs;
+  while (true) {
+    bcf1_t* rec = bcf_init();
+    if (bcf_read(ifile, hdr, rec) != 0) {
+      bcf_destroy(rec);
+      break;
+    }
+    bcf_unpack(rec, BCF_UN_INFO);
+    recs.push_back(rec);
+  }
+  hts_close(ifile);
+  boost::filesystem::remove(path);
+
+  // Identical fields
+  SVRecordDecoder dec(hdr);
+  SVRecordFields f;
+  SVRecordFields ref;
+  bool ok = true;
+  uint32_t nparsed = 0;
+  for(uint32_t i = 0; i < recs.size(); ++i) {
+    bool parsed = _decodeSVRecord(dec, recs[i], f);
+    if ((parsed != _refDecodeSVRecord(hdr, recs[i], ref)) || ((parsed) && (!_sameFields(f, ref)))) {
+      std::cout << "Decoded fields differ for record " << i << ": " << f.svtval << ',' << f.ctval << ',' << f.chr2Name << ',' << f.svEnd << ',' << f.svlen << ',' << f.svt << " vs. " << ref.svtval << ',' << ref.ctval << ',' << ref.chr2Name << ',' << ref.svEnd << ',' << ref.svlen << ',' << ref.svt << std::endl;
+      ok = false;
+      break;
+    }
+    if (parsed) ++nparsed;
+  }
+
+  // Best of 3 runs
+  double tRef = 1e12;
+  double tDec = 1e12;
+  uint64_t checksum = 0;
+  for(uint32_t run = 0; (ok) && (run < 3); ++run) {
+    TBenchClock::time_point t0 = TBenchClock::now();
+    for(uint32_t i = 0; i < recs.size(); ++i) {
+      if (_refDecodeSVRecord(hdr, recs[i], ref)) checksum += ref.svEnd;
+    }
+    TBenchClock::time_point t1 = TBenchClock::now();
+    for(uint32_t i = 0; i < recs.size(); ++i) {
+      if (_decodeSVRecord(dec, recs[i], f)) checksum -= f.svEnd;
+    }
+    TBenchClock::time_point t2 = TBenchClock::now();
+    tRef = std::min(tRef, _benchMs(t0, t1));
+    tDec = std::min(tDec, _benchMs(t1, t2));
+  }
+  if (ok) {
+    std::cout << "SV record decoding, " << recs.size() << " records (" << nparsed << " parsed), best of 3 runs" << std::endl;
+    std::cout << "lookup by name\t" << tRef << " ms\t" << (uint64_t) (recs.size() / (tRef / 1000)) << " records/s" << std::endl;
+    std::cout << "SVRecordDecoder\t" << tDec << " ms\t" << (uint64_t) (recs.size() / (tDec / 1000)) << " records/s\tchecksum " << checksum << std::endl;
+  }
+  for(uint32_t i = 0; i < recs.size(); ++i) bcf_destroy(recs[i]);
+  bcf_hdr_destroy(hdr);
+  return ok ? 0 : 1;
+}
+
+struct ParseBenchConfig {
+  typedef std::map<std::string, int32_t> TChrMap;
+  TChrMap nchr;
+  std::vector<bool> queryChr;
+  std::string feature;
+  std::string idname;
+  boost::filesystem::path gtfFile;
+};
+
+typedef std::vector<std::vector<IntervalLabel> > TBenchRegions;
+
+// GTF parsing before the string_view parser, fields are split with boost::tokenizer and ids are mapped with a std::map
+template<typename TConfig>
+inline int32_t
+_refParseGTFAll(TConfig const& c, TBenchRegions& overlappingRegions, std::vector<std::string>& geneIds, std::vector<bool>& pCoding) {
+  typedef std::map<std::string, int32_t> TIdMap;
+  TIdMap idMap;
+  int32_t eid = 0;
+  std::ifstream file(c.gtfFile.string().c_str(), std::ios_base::in | std::ios_base::binary);
+  boost::iostreams::filtering_streambuf<boost::iostreams::input> dataIn;
+  dataIn.push(boost::iostreams::gzip_decompressor());
+  dataIn.push(file);
+  std::istream instream(&dataIn);
+  std::string gline;
+  while(std::getline(instream, gline)) {
+    if ((gline.size()) && (gline[0] == '#')) continue;
+    typedef boost::tokenizer< boost::char_separator<char> > Tokenizer;
+    boost::char_separator<char> sep("\t");
+    Tokenizer tokens(gline, sep);
+    Tokenizer::iterator tokIter = tokens.begin();
+    if (tokIter==tokens.end()) return 0;
+    std::string chrName=*tokIter++;
+    if (c.nchr.find(chrName) == c.nchr.end()) continue;
+    int32_t chrid = c.nchr.find(chrName)->second;
+    if (tokIter == tokens.end()) return 0;
+    ++tokIter;
+    if (tokIter == tokens.end()) return 0;
+    std::string ft = *tokIter++;
+    if (ft == c.feature) {
+      if (tokIter != tokens.end()) {
+	int32_t start = boost::lexical_cast<int32_t>(*tokIter++);
+	int32_t end = boost::lexical_cast<int32_t>(*tokIter++);
+	++tokIter; // score
+	if (tokIter == tokens.end()) return 0;
+	char strand = boost::lexical_cast<char>(*tokIter++);
+	++tokIter; // frame
+	std::string attr = *tokIter;
+	boost::char_separator<char> sepAttr(";");
+	Tokenizer attrTokens(attr, sepAttr);
+	for(Tokenizer::iterator attrIter = attrTokens.begin(); attrIter != attrTokens.end(); ++attrIter) {
+	  std::string keyval = *attrIter;
+	  boost::trim(keyval);
+	  boost::char_separator<char> sepKeyVal(" ");
+	  Tokenizer kvTokens(keyval, sepKeyVal);
+	  Tokenizer::iterator kvTokensIt = kvTokens.begin();
+	  std::string key = *kvTokensIt++;
+	  if (key == c.idname) {
+	    std::string val = *kvTokensIt;
+	    if (val.size() >= 3) val = val.substr(1, val.size()-2);
+	    int32_t idval = geneIds.size();
+	    TIdMap::const_iterator idIter = idMap.find(val);
+	    if (idIter == idMap.end()) {
+	      idMap.insert(std::make_pair(val, idval));
+	      geneIds.push_back(val);
+	      bool pCode = false;
+	      for(Tokenizer::iterator arIter = attrTokens.begin(); arIter != attrTokens.end(); ++arIter) {
+		std::string kvl = *arIter;
+		boost::trim(kvl);
+		boost::char_separator<char> sKV2(" ");
+		Tokenizer kvT2(kvl, sKV2);
+		Tokenizer::iterator kvT2It = kvT2.begin();
+		std::string procod = *kvT2It++;
+		if (procod == "gene_biotype") {
+		  std::string gbio = *kvT2It;
+		  if (gbio.size() >= 3) gbio = gbio.substr(1, gbio.size()-2);
+		  if (gbio == "protein_coding") pCode = true;
+		}
+	      }
+	      pCoding.push_back(pCode);
+	    } else idval = idIter->second;
+	    if ((start == 0) || (start > end)) return 0;
+	    _insertInterval(overlappingRegions[chrid], start - 1, end, strand, idval, eid++);
+	  }
+	}
+      }
+    }
+  }
+  return geneIds.size();
+}
+
+// Synthetic Ensembl-style GTF with gene, transcript and exon lines
+inline uint64_t
+_syntheticGtf(std::mt19937& rng, ParseBenchConfig const& c, uint32_t const ngenes, boost::filesystem::path const& path) {
+  static char const* const biotypes[3] = {"protein_coding", "lncRNA", "processed_pseudogene"};
+  std::ofstream file(path.string().c_str(), std::ios_base::out | std::ios_base::binary);
+  boost::iostreams::filtering_ostream gtf;
+  gtf.push(boost::iostreams::gzip_compressor());
+  gtf.push(file);
+  std::vector<std::string> chrNames(c.nchr.size());
+  for(ParseBenchConfig::TChrMap::const_iterator it = c.nchr.begin(); it != c.nchr.end(); ++it) chrNames[it->second] = it->first;
+  uint64_t bytes = 0;
+  uint32_t exonId = 0;
+  std::ostringstream line;
+  gtf << "#!genome-build GRCh38.p14" << std::endl;
+  for(uint32_t g = 0; g < ngenes; ++g) {
+    std::string const& chr = chrNames[(g * chrNames.size()) / ngenes];
+    int32_t start = 1 + rng() % 200000000;
+    int32_t nexons = 1 + rng() % 20;
+    char strand = (rng() % 2) ? '+' : '-';
+    std::ostringstream geneAttr;
+    geneAttr << "gene_id \"ENSG" << std::setw(11) << std::setfill('0') << g << "\"; gene_version \"" << 1 + rng() % 20 << "\"; gene_name \"GENE" << g / 2 << "\"; gene_source \"ensembl_havana\"; gene_biotype \"" << biotypes[rng() % 3] << "\";";
+    int32_t end = start + nexons * 3000;
+    line.str("");
+    line << chr << "\tensembl_havana\tgene\t" << start << '\t' << end << "\t.\t" << strand << "\t.\t" << geneAttr.str() << std::endl;
+    line << chr << "\tensembl_havana\ttranscript\t" << start << '\t' << end << "\t.\t" << strand << "\t.\t" << geneAttr.str() << " transcript_id \"ENST" << std::setw(11) << std::setfill('0') << g << "\"; transcript_biotype \"protein_coding\"; tag \"basic\";" << std::endl;
+    for(int32_t e = 0; e < nexons; ++e) {
+      int32_t exonStart = start + e * 3000 + rng() % 1000;
+      line << chr << "\tensembl_havana\texon\t" << exonStart << '\t' << exonStart + 100 + rng() % 1500 << "\t.\t" << strand << "\t.\t" << geneAttr.str() << " transcript_id \"ENST" << std::setw(11) << std::setfill('0') << g << "\"; exon_number \"" << e + 1 << "\"; exon_id \"ENSE" << std::setw(11) << std::setfill('0') << exonId++ << "\"; exon_version \"1\";" << std::endl;
+    }
+    bytes += line.str().size();
+    gtf << line.str();
+  }
+  return bytes;
+}
+
+inline bool
+_parseScenario(ParseBenchConfig& c, std::string const& feature, std::string const& idname, uint64_t const bytes) {
+  c.feature = feature;
+  c.idname = idname;
+
+  // Best of 3 runs
+  double tRef = 1e12;
+  double tParse = 1e12;
+  TBenchRegions refRegions;
+  std::vector<std::string> refIds;
+  std::vector<bool> refCoding;
+  TBenchRegions regions;
+  std::vector<std::string> ids;
+  std::vector<bool> coding;
+  for(uint32_t run = 0; run < 3; ++run) {
+    refRegions.assign(c.nchr.size(), std::vector<IntervalLabel>());
+    refIds.clear();
+    refCoding.clear();
+    regions.assign(c.nchr.size(), std::vector<IntervalLabel>());
+    ids.clear();
+    coding.clear();
+    TBenchClock::time_point t0 = TBenchClock::now();
+    _refParseGTFAll(c, refRegions, refIds, refCoding);
+    TBenchClock::time_point t1 = TBenchClock::now();
+    parseGTFAll(c, regions, ids, coding);
+    TBenchClock::time_point t2 = TBenchClock::now();
+    tRef = std::min(tRef, _benchMs(t0, t1));
+    tParse = std::min(tParse, _benchMs(t1, t2));
+  }
+
+  // Identical ids, biotypes and labelled intervals
+  bool ok = ((refIds == ids) && (refCoding == coding));
+  uint64_t nlabels = 0;
+  for(uint32_t k = 0; (ok) && (k < regions.size()); ++k) {
+    if (refRegions[k].size() != regions[k].size()) ok = false;
+    for(uint32_t i = 0; (ok) && (i < regions[k].size()); ++i) {
+      IntervalLabel const& a = refRegions[k][i];
+      IntervalLabel const& b = regions[k][i];
+      if ((a.start != b.start) || (a.end != b.end) || (a.strand != b.strand) || (a.lid != b.lid)) ok = false;
+    }
+    nlabels += regions[k].size();
+  }
+  if (!ok) {
+    std::cout << "-f " << feature << " -i " << idname << ": parsed features differ" << std::endl;
+    return false;
+  }
+  std::cout << "-f " << feature << " -i " << idname << "\t" << ids.size() << " ids, " << nlabels << " intervals\ttokenizer " << tRef << " ms\tstring_view " << tParse << " ms (" << (bytes / 1048576.0) / (tParse / 1000) << " MB/s)" << std::endl;
+  return true;
+}
+
+// GTF parsing: string_view fields vs. boost::tokenizer
+inline int
+benchParse() {
+  ParseBenchConfig c;
+  for(int32_t k = 1; k <= 22; ++k) c.nchr.insert(std::make_pair(boost::lexical_cast<std::string>(k), (int32_t) c.nchr.size()));
+  c.nchr.insert(std::make_pair(std::string("X"), (int32_t) c.nchr.size()));
+  c.nchr.insert(std::make_pair(std::string("Y"), (int32_t) c.nchr.size()));
+  std::mt19937 rng(13);
+  c.gtfFile = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("sansabench-%%%%-%%%%.gtf.gz");
+  uint64_t bytes = _syntheticGtf(rng, c, 60000, c.gtfFile);
+  std::cout << "GTF parsing, " << bytes / 1048576 << "MB uncompressed, best of 3 runs" << std::endl;
+  bool ok = true;
+  ok &= _parseScenario(c, "gene", "gene_name", bytes);
+  ok &= _parseScenario(c, "exon", "exon_id", bytes);
+  boost::filesystem::remove(c.gtfFile);
+  return ok ? 0 : 1;
+}
+
+// Scoring loop before the specialized match kernel, the overlap is computed by sorting the four breakpoints
+template<typename TConfig, typename TSV>
+inline void
+_refMatchDb(TConfig const& c, SV const& qsv, TSV const& svs, DbMatch& m) {
+  std::vector<typename TSV::const_iterator> hits;
+  svs.candidates(c, qsv, hits);
+  for(uint32_t k = 0; k < hits.size(); ++k) {
+    typename TSV::const_iterator itSV = hits[k];
+    int32_t startDiff = std::abs(itSV->svStart - qsv.svStart);
+    int32_t endDiff = std::abs(itSV->svEnd - qsv.svEnd);
+    float score = 0;
+    if ((itSV->svlen > 0) && (qsv.svlen > 0)) {
+      double rat = (double) itSV->svlen / (double) qsv.svlen;
+      if (qsv.svlen < itSV->svlen) rat = (double) qsv.svlen / (double) itSV->svlen;
+      if (rat < c.sizediff) continue;
+      score += rat;
+      if ( ((qsv.svt < 4) || (qsv.svt > 8)) && ((itSV->svt < 4) || (itSV->svt > 8)) && (qsv.svEnd - qsv.svStart == qsv.svlen) && (itSV->svEnd - itSV->svStart == itSV->svlen)) {
+	if (itSV->svEnd < qsv.svStart) continue;
+	if (qsv.svEnd < itSV->svStart) continue;
+	std::vector<int32_t> posarr;
+	posarr.push_back(itSV->svStart);
+	posarr.push_back(itSV->svEnd);
+	posarr.push_back(qsv.svStart);
+	posarr.push_back(qsv.svEnd);
+	std::sort(posarr.begin(), posarr.end());
+	int32_t intersectionsize = posarr[2] - posarr[1];
+	if (intersectionsize <= 0) continue;
+	double recov = (double) intersectionsize / (double) qsv.svlen;
+	if (recov < c.sizediff) continue;
+	recov = (double) intersectionsize / (double) itSV->svlen;
+	if (recov < c.sizediff) continue;
+      }
+    }
+    m.noMatch = false;
+    if (c.bestMatch) {
+      if (c.bpwindow > 0) {
+	if (startDiff > endDiff) score += (1 - float(startDiff) / (float(c.bpwindow)));
+	else score += (1 - float(endDiff) / (float(c.bpwindow)));
+      } else score += 1;
+      if (score > m.bestScore) {
+	m.bestScore = score;
+	m.bestID = itSV->id;
+      }
+    } else m.ids.push_back(itSV->id);
+  }
+}
+
+// SV matching: specialized kernel vs. the previous scoring loop
+inline int
+benchMatch() {
+  std::mt19937 rng(3);
+
+  // 450k intra-chromosomal sites, 20% additional near-duplicate calls
+  SVDatabase db;
+  uint32_t const nsv = 450000;
+  for(uint32_t i = 0; i < nsv; ++i) {
+    int32_t chr = rng() % 24;
+    int32_t start = rng() % 150000000;
+    int32_t svt = rng() % 10;
+    if ((svt >= 4) && (svt <= 8)) svt = 0;
+    int32_t len = 50 + ((rng() % 3) ? rng() % 2000 : rng() % 200000);
+    db.svs.push_back(SV(chr, start, chr, start + len, i, 0, svt, len));
+  }
+  for(uint32_t i = 0; i < nsv / 5; ++i) {
+    SV sv = db.svs[rng() % nsv];
+    sv.svStart += rng() % 40;
+    sv.svEnd += rng() % 40;
+    sv.svlen = sv.svEnd - sv.svStart;
+    sv.id = db.svs.size();
+    db.svs.push_back(sv);
+  }
+  std::sort(db.svs.begin(), db.svs.end());
+  std::vector<SV> qsvs;
+  for(uint32_t i = 0; i < 500000; ++i) {
+    SV sv = db.svs[rng() % db.svs.size()];
+    sv.svStart += (int32_t) (rng() % 81) - 40;
+    sv.svEnd += (int32_t) (rng() % 81) - 40;
+    sv.svlen = sv.svEnd - sv.svStart;
+    qsvs.push_back(sv);
+  }
+  std::cout << "SV matching, " << db.svs.size() << " database SVs, " << qsvs.size() << " queries, best of 3 runs" << std::endl;
+  for(int32_t strategy = 0; strategy < 2; ++strategy) {
+    for(int32_t bp = 50; bp >= 0; bp -= 50) {
+      BenchConfig c;
+      c.matchSvType = true;
+      c.bestMatch = (strategy == 0);
+      c.bpwindow = bp;
+      c.sizediff = 0.8;
+      db.attach(c);
+      double tRef = 1e12;
+      double tKernel = 1e12;
+      uint64_t checksum = 0;
+      for(uint32_t run = 0; run < 3; ++run) {
+	TBenchClock::time_point t0 = TBenchClock::now();
+	for(uint32_t i = 0; i < qsvs.size(); ++i) {
+	  DbMatch m;
+	  _refMatchDb(c, qsvs[i], db, m);
+	  checksum += m.bestID + m.ids.size();
+	}
+	TBenchClock::time_point t1 = TBenchClock::now();
+	for(uint32_t i = 0; i < qsvs.size(); ++i) {
+	  DbMatch m;
+	  _matchDb(c, qsvs[i], db, m);
+	  checksum -= m.bestID + m.ids.size();
+	}
+	TBenchClock::time_point t2 = TBenchClock::now();
+	tRef = std::min(tRef, _benchMs(t0, t1));
+	tKernel = std::min(tKernel, _benchMs(t1, t2));
+      }
+
+      // Identical matches
+      for(uint32_t i = 0; i < qsvs.size(); ++i) {
+	DbMatch a;
+	DbMatch b;
+	_refMatchDb(c, qsvs[i], db, a);
+	_matchDb(c, qsvs[i], db, b);
+	if ((a.noMatch != b.noMatch) || (a.bestID != b.bestID) || (a.bestScore != b.bestScore) || (a.ids != b.ids)) {
+	  std::cout << "Matches differ for query " << i << std::endl;
+	  return 1;
+	}
+      }
+      std::cout << "-s " << (c.bestMatch ? "best" : "all") << " -b " << bp << "\tprevious loop " << tRef << " ms\tkernel " << tKernel << " ms" << std::endl;
+    }
+  }
+  return 0;
+}
+
+inline void
+displayUsage() {
+  std::cerr << "Usage: sansabench <benchmark>" << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Benchmarks:" << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "    grid         candidate search, window scan vs. breakpoint grid" << std::endl;
+  std::cerr << "    boundary     check that database SVs at the window start are found" << std::endl;
+  std::cerr << "    decode       SV record decoding, SVRecordDecoder vs. INFO lookups by name" << std::endl;
+  std::cerr << "    parse        GTF parsing, string_view fields vs. boost::tokenizer" << std::endl;
+  std::cerr << "    match        SV matching, specialized kernel vs. previous scoring loop" << std::endl;
+  std::cerr << std::endl;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printTitle("Sansa benchmarks");
+    displayUsage();
+    return 0;
+  }
+  if ((std::string(argv[1]) == "grid")) {
+    return benchGrid();
+  }
+  if ((std::string(argv[1]) == "boundary")) {
+    return checkBoundary();
+  }
+  if ((std::string(argv[1]) == "decode")) {
+    return benchDecode();
+  }
+  if ((std::string(argv[1]) == "parse")) {
+    return benchParse();
+  }
+  if ((std::string(argv[1]) == "match")) {
+    return benchMatch();
+  }
+  std::cerr << "Unrecognized benchmark " << std::string(argv[1]) << std::endl;
+  return 1;
+}
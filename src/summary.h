@@ -0,0 +1,118 @@
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <vector>
+#include <cstdio>
+
+#include "util.h"
+#include "itree.h"
+#include "rowwriter.h"
+
+namespace sansa
+{
+
+  // Prefix sums over the start-sorted features of a chromosome
+  struct ChromosomeSummary {
+    std::vector<int32_t> codingPrefix;   // Protein-coding features among the first i features
+    std::vector<int32_t> coverStart;     // Union of all features as sorted, disjoint intervals
+    std::vector<int32_t> coverEnd;
+    std::vector<int64_t> coverPrefix;    // Bases covered by the first i union intervals
+  };
+
+  struct FeatureSummary {
+    std::vector<bool> pCoding;   // Protein-coding flag of each feature label
+    std::vector<ChromosomeSummary> chr;
+  };
+
+  // Contained features of an SV, -1 if not summarized
+  struct ContainedSummary {
+    int32_t nfeatures;
+    int32_t ncoding;
+    float covered;
+
+    ContainedSummary() : nfeatures(-1), ncoding(-1), covered(0) {}
+  };
+
+  template<typename TChromosomeRegions>
+  inline void
+  _buildChromosomeSummary(TChromosomeRegions const& cr, std::vector<bool> const& pCoding, ChromosomeSummary& cs) {
+    cs.codingPrefix.assign(cr.size() + 1, 0);
+    cs.coverStart.clear();
+    cs.coverEnd.clear();
+    for(uint32_t i = 0; i < cr.size(); ++i) {
+      cs.codingPrefix[i + 1] = cs.codingPrefix[i];
+      if ((cr[i].lid >= 0) && ((uint32_t) cr[i].lid < pCoding.size()) && (pCoding[cr[i].lid])) ++cs.codingPrefix[i + 1];
+      if ((!cs.coverEnd.empty()) && (cr[i].start <= cs.coverEnd.back())) {
+	if (cr[i].end > cs.coverEnd.back()) cs.coverEnd.back() = cr[i].end;
+      } else {
+	cs.coverStart.push_back(cr[i].start);
+	cs.coverEnd.push_back(cr[i].end);
+      }
+    }
+    cs.coverPrefix.assign(cs.coverStart.size() + 1, 0);
+    for(uint32_t i = 0; i < cs.coverStart.size(); ++i) cs.coverPrefix[i + 1] = cs.coverPrefix[i] + (cs.coverEnd[i] - cs.coverStart[i]);
+  }
+
+  // gRegions need to be sorted by start
+  template<typename TGenomicRegions>
+  inline void
+  buildFeatureSummary(TGenomicRegions const& gRegions, FeatureSummary& fs) {
+    fs.chr.clear();
+    fs.chr.resize(gRegions.size(), ChromosomeSummary());
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) _buildChromosomeSummary(gRegions[refIndex], fs.pCoding, fs.chr[refIndex]);
+  }
+
+  // Bases of [qs, qe) covered by any feature
+  inline int64_t
+  _coveredBases(ChromosomeSummary const& cs, int32_t const qs, int32_t const qe) {
+    if (qe <= qs) return 0;
+    uint64_t i = std::upper_bound(cs.coverEnd.begin(), cs.coverEnd.end(), qs) - cs.coverEnd.begin();
+    uint64_t j = std::lower_bound(cs.coverStart.begin(), cs.coverStart.end(), qe) - cs.coverStart.begin();
+    if (i >= j) return 0;
+    int64_t bases = cs.coverPrefix[j] - cs.coverPrefix[i];
+    if (cs.coverStart[i] < qs) bases -= qs - cs.coverStart[i];
+    if (cs.coverEnd[j - 1] > qe) bases -= cs.coverEnd[j - 1] - qe;
+    return bases;
+  }
+
+  // Same features as _containedQuery, counted by binary search
+  // Only the few features that start within the SV but extend past its end are visited
+  template<typename TChromosomeRegions>
+  inline void
+  _containedSummary(TChromosomeRegions const& cr, ChromosomeIndex const& ci, ChromosomeSummary const& cs, std::vector<bool> const& pCoding, int32_t const qs, int32_t const qe, ContainedSummary& sum) {
+    uint64_t first = std::lower_bound(cr.begin(), cr.end(), IntervalLabel(qs)) - cr.begin();
+    uint64_t last = std::upper_bound(cr.begin(), cr.end(), IntervalLabel(qe)) - cr.begin();
+    if (last < first) last = first;
+    sum.nfeatures = last - first;
+    sum.ncoding = cs.codingPrefix[last] - cs.codingPrefix[first];
+    std::vector<int32_t> hits;
+    _overlapQuery(cr, ci, qe + 1, qe, hits);
+    for(uint32_t i = 0; i < hits.size(); ++i) {
+      if (cr[hits[i]].start < qs) continue;
+      --sum.nfeatures;
+      int32_t lid = cr[hits[i]].lid;
+      if ((lid >= 0) && ((uint32_t) lid < pCoding.size()) && (pCoding[lid])) --sum.ncoding;
+    }
+    sum.covered = 0;
+    if (qe > qs) sum.covered = (float) _coveredBases(cs, qs, qe) / (float) (qe - qs);
+  }
+
+  // Tab-separated summary columns, NA for inter-chromosomal SVs
+  inline void
+  _appendSummary(std::string& out, ContainedSummary const& sum) {
+    if (sum.nfeatures == -1) {
+      out += "\tNA\tNA\tNA";
+      return;
+    }
+    out += '\t';
+    _appendInt(out, sum.nfeatures);
+    out += '\t';
+    _appendInt(out, sum.ncoding);
+    char fstr[32];
+    snprintf(fstr, sizeof(fstr), "\t%.4f", sum.covered);
+    out += fstr;
+  }
+
+}
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef SVDB_H
+#define SVDB_H
+
+#include <fstream>
+#include <cstring>
+
+#include <boost/filesystem.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "svfilter.h"
+
+namespace sansa
+{
+
+  // Binary SV database layout (version 3)
+  // [SVDatabaseHeader][chromosome dictionary][padding][sorted SV array][padding][database fields][breakpoint grid]
+  // Dictionary entries are (int32 id, uint32 name length, name bytes), the ANNOID of each SV is id%09d of SV::id
+  // Each database field is (uint32 name length, name bytes, padding, uint64 offsets[nid + 1], value bytes, padding)
+  // The breakpoint grid is (GridSlot slots[nslots], int32 svStart[nentries], int32 svEnd[nentries], float svlen[nentries], uint32 pos[nentries])
+  #define SANSA_SVDB_MAGIC "SANSADB"
+  #define SANSA_SVDB_VERSION 3
+
+  // Settings of a single SV database, a -d file with its annotation output and reported fields
+  struct DatabaseConfig {
+    int32_t dbFormat;   // 0 = vcf/bcf, 1 = sansa binary database
+    std::vector<std::string> dbFields;
+    boost::filesystem::path db;
+    boost::filesystem::path annofile;
+  };
+
+  struct SVDatabaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t svsize;
+    uint32_t hasCT;
+    uint32_t nchr;
+    uint64_t nsv;
+    uint64_t svOffset;
+    uint32_t nfields;
+    uint32_t nid;
+    uint64_t fieldOffset;
+    int32_t gridWidth;
+    uint32_t gridSvType;
+    uint64_t nslots;
+    uint64_t nentries;
+    uint64_t gridOffset;
+  };
+
+  // Columnar database INFO fields, the value of field f for SV::id i is data[f][offsets[f][i], offsets[f][i+1])
+  struct DbFields {
+    uint32_t nid;
+    std::vector<std::string> names;
+    std::vector<std::vector<uint64_t> > offsetStore;
+    std::vector<std::string> dataStore;
+    std::vector<uint64_t const*> offsets;
+    std::vector<char const*> data;
+
+    DbFields() : nid(0) {}
+
+    void init(std::vector<std::string> const& fieldNames) {
+      names = fieldNames;
+      offsetStore.assign(names.size(), std::vector<uint64_t>(1, 0));
+      dataStore.assign(names.size(), std::string());
+    }
+
+    void push_back(uint32_t const f, std::string const& val) {
+      dataStore[f] += val;
+      offsetStore[f].push_back(dataStore[f].size());
+    }
+
+    void attach() {
+      offsets.resize(names.size());
+      data.resize(names.size());
+      for(uint32_t f = 0; f < names.size(); ++f) {
+	offsets[f] = &offsetStore[f][0];
+	data[f] = dataStore[f].data();
+      }
+      nid = names.empty() ? 0 : offsetStore[0].size() - 1;
+    }
+
+    int32_t find(std::string const& name) const {
+      for(uint32_t f = 0; f < names.size(); ++f) {
+	if (names[f] == name) return f;
+      }
+      return -1;
+    }
+    
+    void append(std::string& out, uint32_t const f, int32_t const id) const {
+      if ((id < 0) || ((uint32_t) id >= nid)) out += "NA";
+      else out.append(data[f] + offsets[f][id], offsets[f][id + 1] - offsets[f][id]);
+    }
+  };
+
+  // Sorted SV array, either parsed from a VCF/BCF file or memory-mapped from a binary database
+  struct SVDatabase {
+    typedef SV const* const_iterator;
+    std::vector<SV> svs;
+    DbFields fields;
+    std::vector<int32_t> fieldMap;   // requested field -> stored field
+    BreakpointGrid grid;
+    SV const* first;
+    SV const* last;
+    void* mapped;
+    std::size_t mappedSize;
+
+    SVDatabase() : first(NULL), last(NULL), mapped(NULL), mappedSize(0) {}
+
+    ~SVDatabase() {
+      if (mapped != NULL) munmap(mapped, mappedSize);
+    }
+
+    template<typename TConfig>
+    void attach(TConfig const& c) {
+      first = svs.empty() ? NULL : &svs[0];
+      last = first + svs.size();
+      fields.attach();
+      fieldMap.resize(fields.names.size());
+      for(uint32_t f = 0; f < fieldMap.size(); ++f) fieldMap[f] = f;
+      grid.build(c, first, last);
+    }
+
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return last; }
+    std::size_t size() const { return last - first; }
+
+    // Candidate database SVs of a query SV
+    template<typename TConfig>
+    void candidates(TConfig const& c, SV const& qsv, std::vector<const_iterator>& hits) const {
+      grid.candidates(c, first, qsv, hits);
+    }
+
+    // All database SVs are in memory, nothing to load per query batch
+    template<typename TConfig>
+    bool prepare(TConfig const&, DatabaseConfig const&, std::vector<int32_t> const&, std::vector<bcf1_t*> const&, uint32_t const) {
+      return true;
+    }
+
+    // Batches are only limited by the batch size
+    bool splitBatch(bcf1_t const*, bcf1_t const*) const {
+      return false;
+    }
+
+    // Tab-separated values of the requested database fields
+    void appendFields(std::string& out, int32_t const id) const {
+      for(uint32_t f = 0; f < fieldMap.size(); ++f) {
+	out += '\t';
+	fields.append(out, fieldMap[f], id);
+      }
+    }
+
+  private:
+    SVDatabase(SVDatabase const&);
+    SVDatabase& operator=(SVDatabase const&);
+  };
+
+
+  inline bool
+  is_svdb(boost::filesystem::path const& f) {
+    std::ifstream bfile(f.string().c_str(), std::ios_base::binary);
+    if (!bfile) return false;
+    char magic[8];
+    bfile.read(magic, 8);
+    bool svdb = ((bfile.gcount() == 8) && (std::memcmp(magic, SANSA_SVDB_MAGIC, 8) == 0));
+    bfile.close();
+    return svdb;
+  }
+
+  // Breakpoint grid of a binary database, mapped if it was indexed with the same -b and -n, otherwise rebuilt
+  template<typename TConfig>
+  inline bool
+  _loadGrid(TConfig const& c, char const* base, uint64_t const size, SVDatabaseHeader const& header, SVDatabase& db) {
+    if ((header.gridOffset % 8 != 0) || (header.gridOffset > size) || (header.nslots > (size - header.gridOffset) / sizeof(GridSlot))) return false;
+    uint64_t colOffset = header.gridOffset + header.nslots * sizeof(GridSlot);
+    if (header.nentries > (size - colOffset) / (4 * sizeof(int32_t))) return false;
+    if ((header.gridWidth != BreakpointGrid::cellWidth(c)) || ((header.gridSvType != 0) != c.matchSvType)) {
+      boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+      std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Build breakpoint grid, the database was indexed with a different -b or -n" << std::endl;
+      db.grid.build(c, db.first, db.last);
+      return true;
+    }
+
+    // Power-of-2 table with at least one empty slot and cells within the columns
+    if ((header.nslots < 2) || (header.nslots & (header.nslots - 1))) return false;
+    GridSlot const* slots = (GridSlot const*) (base + header.gridOffset);
+    uint64_t nempty = 0;
+    for(uint64_t i = 0; i < header.nslots; ++i) {
+      if (!slots[i].end) ++nempty;
+      else if ((slots[i].begin >= slots[i].end) || (slots[i].end > header.nentries)) return false;
+    }
+    if (!nempty) return false;
+    GridColumns col;
+    col.svStart = (int32_t const*) (base + colOffset);
+    col.svEnd = col.svStart + header.nentries;
+    col.svlen = (float const*) (col.svEnd + header.nentries);
+    col.pos = (uint32_t const*) (col.svlen + header.nentries);
+    for(uint64_t i = 0; i < header.nentries; ++i) {
+      if (col.pos[i] >= header.nsv) return false;
+    }
+    db.grid.map(header.gridWidth, header.gridSvType, slots, header.nslots, col, header.nentries);
+    return true;
+  }
+
+  template<typename TChrMap, typename TSV>
+  inline bool
+  writeSVDatabase(boost::filesystem::path const& outfile, TChrMap const& nchr, bool const hasCT, TSV const& svs, DbFields const& fields, BreakpointGrid const& grid) {
+    SVDatabaseHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SANSA_SVDB_MAGIC, 8);
+    header.version = SANSA_SVDB_VERSION;
+    header.svsize = sizeof(SV);
+    header.hasCT = hasCT;
+    header.nchr = nchr.size();
+    header.nsv = svs.size();
+    uint64_t dictSize = 0;
+    for(typename TChrMap::const_iterator itcm = nchr.begin(); itcm != nchr.end(); ++itcm) dictSize += 2 * sizeof(uint32_t) + itcm->first.size();
+    header.svOffset = sizeof(SVDatabaseHeader) + dictSize;
+    uint64_t padding = (8 - header.svOffset % 8) % 8;
+    header.svOffset += padding;
+    header.nfields = fields.names.size();
+    header.nid = fields.nid;
+    header.fieldOffset = header.svOffset + svs.size() * sizeof(SV);
+    header.gridWidth = grid.width;
+    header.gridSvType = grid.svType;
+    header.nslots = grid.nslots;
+    header.nentries = grid.nentries;
+    header.gridOffset = header.fieldOffset;
+    for(uint32_t f = 0; f < fields.names.size(); ++f) {
+      uint64_t len = sizeof(uint32_t) + fields.names[f].size();
+      uint64_t dataSize = fields.offsets[f][fields.nid];
+      header.gridOffset += len + (8 - len % 8) % 8 + (fields.nid + 1) * sizeof(uint64_t) + dataSize + (8 - dataSize % 8) % 8;
+    }
+
+    std::ofstream ofile(outfile.string().c_str(), std::ios_base::out | std::ios_base::binary);
+    if (!ofile) {
+      std::cerr << "Fail to open output file " << outfile.string() << std::endl;
+      return false;
+    }
+    ofile.write((char const*) &header, sizeof(header));
+    for(typename TChrMap::const_iterator itcm = nchr.begin(); itcm != nchr.end(); ++itcm) {
+      int32_t id = itcm->second;
+      uint32_t len = itcm->first.size();
+      ofile.write((char const*) &id, sizeof(id));
+      ofile.write((char const*) &len, sizeof(len));
+      ofile.write(itcm->first.data(), len);
+    }
+    char const zero[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    ofile.write(zero, padding);
+    if (!svs.empty()) ofile.write((char const*) &svs[0], svs.size() * sizeof(SV));
+    for(uint32_t f = 0; f < fields.names.size(); ++f) {
+      uint32_t len = fields.names[f].size();
+      ofile.write((char const*) &len, sizeof(len));
+      ofile.write(fields.names[f].data(), len);
+      ofile.write(zero, (8 - (sizeof(len) + len) % 8) % 8);
+      ofile.write((char const*) fields.offsets[f], (fields.nid + 1) * sizeof(uint64_t));
+      uint64_t dataSize = fields.offsets[f][fields.nid];
+      ofile.write(fields.data[f], dataSize);
+      ofile.write(zero, (8 - dataSize % 8) % 8);
+    }
+    ofile.write((char const*) grid.slots, grid.nslots * sizeof(GridSlot));
+    ofile.write((char const*) grid.entries.svStart, grid.nentries * sizeof(int32_t));
+    ofile.write((char const*) grid.entries.svEnd, grid.nentries * sizeof(int32_t));
+    ofile.write((char const*) grid.entries.svlen, grid.nentries * sizeof(float));
+    ofile.write((char const*) grid.entries.pos, grid.nentries * sizeof(uint32_t));
+    ofile.close();
+    if (!ofile) {
+      std::cerr << "Error writing SV database " << outfile.string() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // The sequence dictionary of the database is returned in dbchr
+  template<typename TConfig>
+  inline bool
+  loadSVDatabase(TConfig const& c, DatabaseConfig const& d, SVDatabase& db, typename TConfig::TChrMap& dbchr) {
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Load binary SV annotation database" << std::endl;
+
+    int fd = open(d.db.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Fail to load " << d.db.string() << std::endl;
+      return false;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t) sizeof(SVDatabaseHeader))) {
+      std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+      close(fd);
+      return false;
+    }
+    void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      std::cerr << "Fail to memory-map " << d.db.string() << std::endl;
+      return false;
+    }
+    db.mapped = mapped;
+    db.mappedSize = st.st_size;
+
+    // Check header
+    char const* base = (char const*) mapped;
+    SVDatabaseHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, SANSA_SVDB_MAGIC, 8) != 0) {
+      std::cerr << "Not a sansa SV database: " << d.db.string() << std::endl;
+      return false;
+    }
+    if ((header.version != SANSA_SVDB_VERSION) || (header.svsize != sizeof(SV))) {
+      std::cerr << "SV database version mismatch, please rebuild " << d.db.string() << " using sansa dbindex" << std::endl;
+      return false;
+    }
+    if ((header.svOffset % 8 != 0) || (header.svOffset > (uint64_t) st.st_size) || (header.nsv > ((uint64_t) st.st_size - header.svOffset) / sizeof(SV))) {
+      std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+      return false;
+    }
+
+    // Chromosome dictionary
+    uint64_t offset = sizeof(SVDatabaseHeader);
+    uint64_t dictEnd = std::min<uint64_t>(header.svOffset, st.st_size);
+    for(uint32_t i = 0; i < header.nchr; ++i) {
+      int32_t id;
+      uint32_t len;
+      if (offset + sizeof(id) + sizeof(len) > dictEnd) {
+	std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+	return false;
+      }
+      std::memcpy(&id, base + offset, sizeof(id));
+      std::memcpy(&len, base + offset + sizeof(id), sizeof(len));
+      offset += sizeof(id) + sizeof(len);
+      if (offset + len > dictEnd) {
+	std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+	return false;
+      }
+      if ((id < 0) || ((uint32_t) id >= header.nchr)) {
+	std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+	return false;
+      }
+      dbchr.insert(std::make_pair(std::string(base + offset, len), id));
+      offset += len;
+    }
+    if (header.svOffset < offset) {
+      std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+      return false;
+    }
+
+    // Sorted SVs
+    db.first = (SV const*) (base + header.svOffset);
+    db.last = db.first + header.nsv;
+    for(SV const* itSV = db.first; itSV != db.last; ++itSV) {
+      if ((itSV->id != -1) && (((uint32_t) itSV->chr >= header.nchr) || ((uint32_t) itSV->chr2 >= header.nchr))) {
+	std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+	return false;
+      }
+    }
+
+    // Database fields
+    offset = header.fieldOffset;
+    db.fields.nid = header.nid;
+    uint64_t size = st.st_size;
+    for(uint32_t f = 0; f < header.nfields; ++f) {
+      uint32_t len;
+      if ((offset > size) || (size - offset < sizeof(len))) break;
+      std::memcpy(&len, base + offset, sizeof(len));
+      if (size - offset - sizeof(len) < len) break;
+      db.fields.names.push_back(std::string(base + offset + sizeof(len), len));
+      offset += sizeof(len) + len;
+      offset += (8 - offset % 8) % 8;
+      if ((offset > size) || ((size - offset) / sizeof(uint64_t) < (uint64_t) header.nid + 1)) break;
+      uint64_t const* offsets = (uint64_t const*) (base + offset);
+      offset += ((uint64_t) header.nid + 1) * sizeof(uint64_t);
+      uint64_t dataSize = offsets[header.nid];
+      if (size - offset < dataSize) break;
+      uint32_t i = 0;
+      for(; (i < header.nid) && (offsets[i] <= offsets[i + 1]); ++i);
+      if (i < header.nid) break;
+      db.fields.offsets.push_back(offsets);
+      db.fields.data.push_back(base + offset);
+      offset += dataSize + (8 - dataSize % 8) % 8;
+    }
+    if ((db.fields.names.size() != header.nfields) || (db.fields.offsets.size() != header.nfields) || (db.fields.data.size() != header.nfields)) {
+      std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+      return false;
+    }
+
+    // Requested database fields
+    for(uint32_t f = 0; f < d.dbFields.size(); ++f) {
+      int32_t idx = db.fields.find(d.dbFields[f]);
+      if (idx == -1) {
+	std::cerr << "Database field " << d.dbFields[f] << " is not present in " << d.db.string() << ", please rebuild it using sansa dbindex --db-fields" << std::endl;
+	return false;
+      }
+      db.fieldMap.push_back(idx);
+    }
+    if (!_loadGrid(c, base, size, header, db)) {
+      std::cerr << "Corrupted SV database " << d.db.string() << std::endl;
+      return false;
+    }
+
+    now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Loaded " << header.nsv << " database SVs." << std::endl;
+    return true;
+  }
+
+}
+
+#endif
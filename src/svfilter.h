@@ -0,0 +1,322 @@
+#ifndef SVFILTER_H
+#define SVFILTER_H
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
+
+namespace sansa
+{
+
+  // Database SVs within bpwindow of both query breakpoints, in array order
+  template<typename TConfig, typename TIterator>
+  inline void
+  _windowCandidates(TConfig const& c, TIterator itFirst, TIterator itLast, SV const& qsv, std::vector<TIterator>& hits) {
+    hits.clear();
+    TIterator itSV = std::lower_bound(itFirst, itLast, SV(qsv.chr, std::max(0, qsv.svStart - c.bpwindow), -1, -1));
+    for(; itSV != itLast; ++itSV) {
+      if (itSV->chr != qsv.chr) break;
+      if (std::abs(itSV->svStart - qsv.svStart) > c.bpwindow) break;
+      if (itSV->chr2 != qsv.chr2) continue;
+      if ((c.matchSvType) && (itSV->svt != qsv.svt)) continue;
+      if (std::abs(itSV->svEnd - qsv.svEnd) > c.bpwindow) continue;
+      if (itSV->id == -1) continue;
+      hits.push_back(itSV);
+    }
+  }
+
+  // Breakpoint grid cell, start and end are in units of the cell width
+  struct GridCell {
+    int32_t chr;
+    int32_t chr2;
+    int32_t svt;
+    int32_t start;
+    int32_t end;
+
+    GridCell() : chr(-1), chr2(-1), svt(-1), start(0), end(0) {}
+
+    GridCell(int32_t const c1, int32_t const c2, int32_t const t, int32_t const s, int32_t const e) : chr(c1), chr2(c2), svt(t), start(s), end(e) {}
+
+    bool operator==(GridCell const& g2) const {
+      return ((start == g2.start) && (end == g2.end) && (chr == g2.chr) && (chr2 == g2.chr2) && (svt == g2.svt));
+    }
+
+    bool operator<(GridCell const& g2) const {
+      return ((chr<g2.chr) || ((chr==g2.chr) && (chr2<g2.chr2)) || ((chr==g2.chr) && (chr2==g2.chr2) && (svt<g2.svt)) || ((chr==g2.chr) && (chr2==g2.chr2) && (svt==g2.svt) && (start<g2.start)) || ((chr==g2.chr) && (chr2==g2.chr2) && (svt==g2.svt) && (start==g2.start) && (end<g2.end)));
+    }
+  };
+
+  inline std::size_t
+  hash_value(GridCell const& g) {
+    std::size_t seed = 0;
+    boost::hash_combine(seed, g.chr);
+    boost::hash_combine(seed, g.chr2);
+    boost::hash_combine(seed, g.svt);
+    boost::hash_combine(seed, g.start);
+    boost::hash_combine(seed, g.end);
+    return seed;
+  }
+
+  // Occupied slot of the open-addressing cell table, SVs of the cell are entries [begin, end)
+  struct GridSlot {
+    GridCell cell;
+    uint32_t begin;
+    uint32_t end;
+
+    GridSlot() : begin(0), end(0) {}
+  };
+
+  // Query window of the column filter, a conservative size ratio check is refined during scoring
+  struct GridQuery {
+    int32_t svStart;
+    int32_t svEnd;
+    int32_t bpwindow;
+    float svlen;
+    float ratio;
+  };
+
+  // Per-field columns of the database SVs in cell order, pos is the position in the sorted SV array
+  struct GridColumns {
+    int32_t const* svStart;
+    int32_t const* svEnd;
+    float const* svlen;
+    uint32_t const* pos;
+
+    GridColumns() : svStart(NULL), svEnd(NULL), svlen(NULL), pos(NULL) {}
+  };
+
+  // Scalar lane test of the column filter
+  inline bool
+  _gridCandidate(GridColumns const& col, uint32_t const i, GridQuery const& q) {
+    if ((col.svStart[i] < q.svStart - q.bpwindow) || (col.svStart[i] > q.svStart + q.bpwindow)) return false;
+    if ((col.svEnd[i] < q.svEnd - q.bpwindow) || (col.svEnd[i] > q.svEnd + q.bpwindow)) return false;
+    if ((col.svlen[i] > 0) && (q.svlen > 0) && (std::min(col.svlen[i], q.svlen) < q.ratio * std::max(col.svlen[i], q.svlen))) return false;
+    return true;
+  }
+
+  // Candidates of one grid cell [begin, end), four SVs are tested at once
+  inline void
+  _gridCellCandidates(GridColumns const& col, uint32_t begin, uint32_t const end, GridQuery const& q, SV const* first, std::vector<SV const*>& hits) {
+#ifdef __SSE2__
+    __m128i vStartLow = _mm_set1_epi32(q.svStart - q.bpwindow - 1);
+    __m128i vStartHigh = _mm_set1_epi32(q.svStart + q.bpwindow + 1);
+    __m128i vEndLow = _mm_set1_epi32(q.svEnd - q.bpwindow - 1);
+    __m128i vEndHigh = _mm_set1_epi32(q.svEnd + q.bpwindow + 1);
+    __m128 vQlen = _mm_set1_ps(q.svlen);
+    __m128 vRatio = _mm_set1_ps(q.ratio);
+    __m128 vZero = _mm_setzero_ps();
+    bool lenCheck = (q.svlen > 0);
+    for(; begin + 4 <= end; begin += 4) {
+      __m128i start = _mm_loadu_si128((__m128i const*) &col.svStart[begin]);
+      __m128i stop = _mm_loadu_si128((__m128i const*) &col.svEnd[begin]);
+      __m128i m = _mm_and_si128(_mm_cmpgt_epi32(start, vStartLow), _mm_cmplt_epi32(start, vStartHigh));
+      m = _mm_and_si128(m, _mm_and_si128(_mm_cmpgt_epi32(stop, vEndLow), _mm_cmplt_epi32(stop, vEndHigh)));
+      if (lenCheck) {
+	__m128 len = _mm_loadu_ps(&col.svlen[begin]);
+	__m128 fail = _mm_cmplt_ps(_mm_min_ps(len, vQlen), _mm_mul_ps(vRatio, _mm_max_ps(len, vQlen)));
+	fail = _mm_and_ps(fail, _mm_cmpgt_ps(len, vZero));
+	m = _mm_andnot_si128(_mm_castps_si128(fail), m);
+      }
+      for(int32_t mask = _mm_movemask_ps(_mm_castsi128_ps(m)); mask; mask &= mask - 1) hits.push_back(first + col.pos[begin + __builtin_ctz(mask)]);
+    }
+#endif
+    for(; begin < end; ++begin) {
+      if (_gridCandidate(col, begin, q)) hits.push_back(first + col.pos[begin]);
+    }
+  }
+
+  // Database SVs hashed by (chr, chr2, svt, start cell, end cell) with cells 2 * bpwindow + 1 wide
+  // A query probes at most 2x2 cells instead of scanning all SVs of its start window, e.g. in SV hotspots
+  // SVs of a cell are filtered column-wise, hotspot cells can hold thousands of SVs
+  struct BreakpointGrid {
+    int32_t width;
+    bool svType;   // Cells are split by SV type (-n not set)
+    std::vector<GridSlot> slotStore;   // Built grid, empty if the grid is mapped from a binary database
+    std::vector<int32_t> startStore;
+    std::vector<int32_t> endStore;
+    std::vector<float> lenStore;
+    std::vector<uint32_t> posStore;
+    GridSlot const* slots;   // Power-of-2 sized, linear probing, end == 0 is an empty slot
+    uint64_t nslots;
+    uint64_t nentries;
+    GridColumns entries;
+
+    BreakpointGrid() : width(1), svType(true), slots(NULL), nslots(0), nentries(0) {}
+
+    template<typename TConfig>
+    static int32_t cellWidth(TConfig const& c) {
+      return 2 * std::max(c.bpwindow, 0) + 1;
+    }
+
+    int32_t cell(int32_t const pos) const {
+      if (pos >= 0) return pos / width;
+      return -((width - 1 - pos) / width);
+    }
+
+    GridCell key(SV const& sv) const {
+      return GridCell(sv.chr, sv.chr2, svType ? sv.svt : 0, cell(sv.svStart), cell(sv.svEnd));
+    }
+
+    GridSlot const* find(GridCell const& g) const {
+      if (!nslots) return NULL;
+      std::size_t mask = nslots - 1;
+      for(std::size_t h = hash_value(g) & mask; slots[h].end; h = (h + 1) & mask) {
+	if (slots[h].cell == g) return &slots[h];
+      }
+      return NULL;
+    }
+
+    void attach() {
+      slots = slotStore.data();
+      nslots = slotStore.size();
+      nentries = posStore.size();
+      entries.svStart = startStore.data();
+      entries.svEnd = endStore.data();
+      entries.svlen = lenStore.data();
+      entries.pos = posStore.data();
+    }
+
+    // Grid stored in a binary database, the arrays must outlive the grid
+    void map(int32_t const w, bool const t, GridSlot const* s, uint64_t const ns, GridColumns const& col, uint64_t const n) {
+      std::vector<GridSlot>().swap(slotStore);
+      std::vector<int32_t>().swap(startStore);
+      std::vector<int32_t>().swap(endStore);
+      std::vector<float>().swap(lenStore);
+      std::vector<uint32_t>().swap(posStore);
+      width = w;
+      svType = t;
+      slots = s;
+      nslots = ns;
+      entries = col;
+      nentries = n;
+    }
+
+    template<typename TConfig>
+    void build(TConfig const& c, SV const* first, SV const* last) {
+      width = cellWidth(c);
+      svType = c.matchSvType;
+      std::vector<std::pair<GridCell, uint32_t> > order;
+      for(SV const* itSV = first; itSV != last; ++itSV) {
+	if (itSV->id != -1) order.push_back(std::make_pair(key(*itSV), (uint32_t) (itSV - first)));
+      }
+      std::sort(order.begin(), order.end());
+      startStore.resize(order.size());
+      endStore.resize(order.size());
+      lenStore.resize(order.size());
+      posStore.resize(order.size());
+      uint32_t ncell = 0;
+      for(uint32_t i = 0; i < order.size(); ++i) {
+	SV const& sv = first[order[i].second];
+	startStore[i] = sv.svStart;
+	endStore[i] = sv.svEnd;
+	lenStore[i] = sv.svlen;
+	posStore[i] = order[i].second;
+	if ((i == 0) || (!(order[i].first == order[i - 1].first))) ++ncell;
+      }
+      std::size_t nslot = 2;
+      while (nslot < 2 * (std::size_t) ncell) nslot <<= 1;
+      slotStore.assign(nslot, GridSlot());
+      std::size_t mask = nslot - 1;
+      for(uint32_t i = 0; i < order.size(); ) {
+	uint32_t j = i + 1;
+	while ((j < order.size()) && (order[j].first == order[i].first)) ++j;
+	std::size_t h = hash_value(order[i].first) & mask;
+	while (slotStore[h].end) h = (h + 1) & mask;
+	slotStore[h].cell = order[i].first;
+	slotStore[h].begin = i;
+	slotStore[h].end = j;
+	i = j;
+      }
+      attach();
+    }
+
+    // Candidates of a query SV in array order
+    template<typename TConfig>
+    void candidates(TConfig const& c, SV const* first, SV const& qsv, std::vector<SV const*>& hits) const {
+      hits.clear();
+      GridQuery q;
+      q.svStart = qsv.svStart;
+      q.svEnd = qsv.svEnd;
+      q.bpwindow = c.bpwindow;
+      q.svlen = qsv.svlen;
+      q.ratio = 0.999f * c.sizediff;
+      GridCell g = key(qsv);
+      int32_t startLast = cell(qsv.svStart + c.bpwindow);
+      int32_t endFirst = cell(qsv.svEnd - c.bpwindow);
+      int32_t endLast = cell(qsv.svEnd + c.bpwindow);
+      for(g.start = cell(qsv.svStart - c.bpwindow); g.start <= startLast; ++g.start) {
+	for(g.end = endFirst; g.end <= endLast; ++g.end) {
+	  GridSlot const* slot = find(g);
+	  if (slot != NULL) _gridCellCandidates(entries, slot->begin, slot->end, q, first, hits);
+	}
+      }
+      // Equally good matches are resolved in array order
+      std::sort(hits.begin(), hits.end());
+    }
+  };
+
+  // Inter-chromosomal database SVs bucketed by chromosome pair and sorted by both breakpoints
+  // A translocation query only scans SVs of its own chromosome pair within the start window
+  struct ChrPairIndex {
+    typedef boost::unordered_map<std::pair<int32_t, int32_t>, std::pair<uint32_t, uint32_t> > TPairMap;
+    TPairMap pairs;   // (chr, chr2) -> [begin, end) in the arrays below
+    std::vector<int32_t> svStart;
+    std::vector<uint32_t> pos;   // Position in the sorted SV array
+
+    void build(SV const* first, SV const* last) {
+      std::vector<std::pair<SV, uint32_t> > order;
+      for(SV const* itSV = first; itSV != last; ++itSV) {
+	if (itSV->id != -1) order.push_back(std::make_pair(SV(itSV->chr, itSV->svStart, itSV->chr2, itSV->svEnd), (uint32_t) (itSV - first)));
+      }
+      std::sort(order.begin(), order.end(), _pairOrder);
+      pairs.clear();
+      svStart.resize(order.size());
+      pos.resize(order.size());
+      for(uint32_t i = 0; i < order.size(); ++i) {
+	svStart[i] = order[i].first.svStart;
+	pos[i] = order[i].second;
+	std::pair<int32_t, int32_t> chrPair(order[i].first.chr, order[i].first.chr2);
+	std::pair<TPairMap::iterator, bool> res = pairs.insert(std::make_pair(chrPair, std::make_pair(i, i + 1)));
+	if (!res.second) res.first->second.second = i + 1;
+      }
+    }
+
+    // Same candidates as _windowCandidates, in array order
+    template<typename TConfig>
+    void candidates(TConfig const& c, SV const* first, SV const& qsv, std::vector<SV const*>& hits) const {
+      hits.clear();
+      TPairMap::const_iterator it = pairs.find(std::make_pair(qsv.chr, qsv.chr2));
+      if (it == pairs.end()) return;
+      uint32_t i = std::lower_bound(svStart.begin() + it->second.first, svStart.begin() + it->second.second, qsv.svStart - c.bpwindow) - svStart.begin();
+      for(; (i < it->second.second) && (svStart[i] <= qsv.svStart + c.bpwindow); ++i) {
+	SV const* itSV = first + pos[i];
+	if ((c.matchSvType) && (itSV->svt != qsv.svt)) continue;
+	if (std::abs(itSV->svEnd - qsv.svEnd) > c.bpwindow) continue;
+	hits.push_back(itSV);
+      }
+      std::sort(hits.begin(), hits.end());
+    }
+
+  private:
+    static bool _pairOrder(std::pair<SV, uint32_t> const& a, std::pair<SV, uint32_t> const& b) {
+      SV const& x = a.first;
+      SV const& y = b.first;
+      if (x.chr != y.chr) return x.chr < y.chr;
+      if (x.chr2 != y.chr2) return x.chr2 < y.chr2;
+      if (x.svStart != y.svStart) return x.svStart < y.svStart;
+      if (x.svEnd != y.svEnd) return x.svEnd < y.svEnd;
+      return a.second < b.second;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <htslib/vcf.h>
+
+#include "util.h"
+#include "parsedb.h"
+#include "svfilter.h"
+
+namespace sansa
+{
+
+  // Max. query span of a streaming batch in bp, the database window holds the SVs of this span plus 2 * bpwindow
+  #define SANSA_SWEEP_SPAN 100000
+
+  // Sorted buffer of database SVs, the front is released once the query sweep has passed it
+  struct SVWindow {
+    typedef boost::unordered_map<int32_t, std::string> TFieldRows;
+    std::vector<SV> svs;
+    TFieldRows rows;
+    std::size_t head;
+
+    SVWindow() : head(0) {}
+
+    SV const* begin() const { return svs.empty() ? NULL : &svs[0] + head; }
+    SV const* end() const { return svs.empty() ? NULL : &svs[0] + svs.size(); }
+    std::size_t size() const { return svs.size() - head; }
+
+    void insert(SV const& sv, std::string const& row) {
+      svs.insert(std::upper_bound(svs.begin() + head, svs.end(), sv), sv);
+      if (!row.empty()) rows[sv.id] = row;
+    }
+
+    void append(SV const& sv, std::string const& row) {
+      svs.push_back(sv);
+      if (!row.empty()) rows[sv.id] = row;
+    }
+
+    void sort() {
+      std::sort(svs.begin() + head, svs.end());
+    }
+
+    // Drop all SVs before (chr, pos), compact once the released part dominates
+    void release(int32_t const chr, int32_t const pos) {
+      while ((head < svs.size()) && ((svs[head].chr < chr) || ((svs[head].chr == chr) && (svs[head].svStart < pos)))) {
+	rows.erase(svs[head].id);
+	++head;
+      }
+      if ((head > 4096) && (2 * head > svs.size())) {
+	svs.erase(svs.begin(), svs.begin() + head);
+	head = 0;
+      }
+    }
+
+    bool appendFields(std::string& out, int32_t const id) const {
+      TFieldRows::const_iterator it = rows.find(id);
+      if (it == rows.end()) return false;
+      out += it->second;
+      return true;
+    }
+  };
+
+  // Sequential reader of the parsed database SVs, ids follow the record order as in parseDB
+  struct DbRecordReader {
+    htsFile* ifile;
+    bcf_hdr_t* hdr;
+    bcf1_t* rec;
+    SVRecordDecoder dec;
+    SVRecordFields svFields;
+    std::vector<int32_t> fieldType;
+    void* fieldBuf;
+    int32_t nFieldBuf;
+    int32_t svid;
+    int32_t sitecount;
+    int32_t lastRID;
+    int32_t refIndex;
+
+    DbRecordReader() : ifile(NULL), hdr(NULL), rec(NULL), fieldBuf(NULL), nFieldBuf(0), svid(0), sitecount(0), lastRID(-1), refIndex(-1) {}
+
+    template<typename TConfig>
+    bool open(TConfig const& c, DatabaseConfig const& d) {
+      ifile = bcf_open(d.db.string().c_str(), "r");
+      if (ifile == NULL) {
+	std::cerr << "Fail to load " << d.db.string() << std::endl;
+	return false;
+      }
+      _attachThreadPool(ifile, c.tpool);
+      hdr = bcf_hdr_read(ifile);
+      dec.init(hdr);
+      rec = bcf_init();
+      svid = 0;
+      sitecount = 0;
+      lastRID = -1;
+      refIndex = -1;
+      return _dbFieldTypes(d, hdr, fieldType);
+    }
+
+    // Next parsed database SV and its tab-prefixed field values
+    template<typename TConfig>
+    bool next(TConfig const& c, DatabaseConfig const& d, SV& sv, std::string& row) {
+      while (bcf_read(ifile, hdr, rec) == 0) {
+	++sitecount;
+	if (rec->rid != lastRID) {
+	  lastRID = rec->rid;
+	  std::string chrName = bcf_hdr_id2name(hdr, rec->rid);
+	  refIndex = _chrIndex(c.nchr, chrName);
+	}
+	if (_parseDbRecord(c, dec, rec, refIndex, svid, svFields, sv)) {
+	  row.clear();
+	  std::string fieldVal;
+	  for(uint32_t f = 0; f < fieldType.size(); ++f) {
+	    _dbFieldValue(hdr, rec, d.dbFields[f], fieldType[f], &fieldBuf, &nFieldBuf, fieldVal);
+	    row += '\t';
+	    row += fieldVal;
+	  }
+	  ++svid;
+	  return true;
+	}
+      }
+      return false;
+    }
+
+    void close() {
+      if (fieldBuf != NULL) free(fieldBuf);
+      fieldBuf = NULL;
+      nFieldBuf = 0;
+      if (rec != NULL) bcf_destroy(rec);
+      rec = NULL;
+      if (hdr != NULL) bcf_hdr_destroy(hdr);
+      hdr = NULL;
+      if (ifile != NULL) bcf_close(ifile);
+      ifile = NULL;
+    }
+  };
+
+  // Sort-merge sweep over a coordinate-sorted database and query
+  // Intra-chromosomal database SVs are streamed through a window of +/- bpwindow around the current query batch,
+  // inter-chromosomal SVs are collected in a first pass because their canonical start lies on the mate chromosome
+  struct SVSweep {
+    typedef SV const* const_iterator;
+    uint32_t nfields;
+    int32_t nDbChr;
+    SVWindow intra;
+    SVWindow inter;
+    ChrPairIndex interIndex;   // Built once, inter is never released
+    DbRecordReader reader;
+    SV pending;
+    std::string pendingRow;
+    bool hasPending;
+    int32_t dbChr;
+    int32_t dbPos;
+    int32_t qChr;
+    int32_t qPos;
+    std::size_t peakWindow;
+
+    SVSweep() : nfields(0), nDbChr(0), hasPending(false), dbChr(-1), dbPos(0), qChr(-1), qPos(0), peakWindow(0) {}
+
+    ~SVSweep() {
+      reader.close();
+    }
+
+    // The intra-chromosomal window changes with every query batch, its candidates are scanned without an index
+    template<typename TConfig>
+    void candidates(TConfig const& c, SV const& qsv, std::vector<const_iterator>& hits) const {
+      if (qsv.chr == qsv.chr2) _windowCandidates(c, intra.begin(), intra.end(), qsv, hits);
+      else interIndex.candidates(c, inter.begin(), qsv, hits);
+    }
+
+    // Query batches stay on one contig and within SANSA_SWEEP_SPAN, so the window does not grow with the batch size
+    bool splitBatch(bcf1_t const* first, bcf1_t const* rec) const {
+      return ((rec->rid != first->rid) || (rec->pos - first->pos > SANSA_SWEEP_SPAN));
+    }
+
+    void appendFields(std::string& out, int32_t const id) const {
+      if (!nfields) return;
+      if ((id != -1) && ((intra.appendFields(out, id)) || (inter.appendFields(out, id)))) return;
+      for(uint32_t f = 0; f < nfields; ++f) out += "\tNA";
+    }
+
+    // Advance to the next intra-chromosomal database SV
+    template<typename TConfig>
+    bool _nextIntra(TConfig const& c, DatabaseConfig const& d) {
+      hasPending = false;
+      while (reader.next(c, d, pending, pendingRow)) {
+	if (pending.chr != pending.chr2) continue;
+	if ((pending.chr < dbChr) || ((pending.chr == dbChr) && (pending.svStart < dbPos))) {
+	  std::cerr << "Database is not coordinate-sorted in its sequence dictionary order: " << d.db.string() << std::endl;
+	  return false;
+	}
+	dbChr = pending.chr;
+	dbPos = pending.svStart;
+	hasPending = true;
+	break;
+      }
+      return true;
+    }
+
+    // Load all database SVs required by the query batch and release the ones left behind
+    template<typename TConfig>
+    bool prepare(TConfig const& c, DatabaseConfig const& d, std::vector<int32_t> const& ridMap, std::vector<bcf1_t*> const& batch, uint32_t const nrec) {
+      int32_t firstChr = -1;
+      int32_t firstPos = 0;
+      for(uint32_t i = 0; i < nrec; ++i) {
+	int32_t chr = ridMap[batch[i]->rid];
+	if (chr >= nDbChr) continue;  // Contig without database SVs
+	int32_t pos = batch[i]->pos + 1;
+	if ((chr < qChr) || ((chr == qChr) && (pos < qPos))) {
+	  std::cerr << "Query is not coordinate-sorted in the database sequence dictionary order: " << c.infile.string() << std::endl;
+	  return false;
+	}
+	if (firstChr == -1) {
+	  firstChr = chr;
+	  firstPos = std::max(0, pos - c.bpwindow);
+	}
+	qChr = chr;
+	qPos = pos;
+      }
+      if (firstChr == -1) return true;
+
+      intra.release(firstChr, firstPos);
+      int32_t lastPos = qPos + c.bpwindow;
+      while (hasPending) {
+	if ((pending.chr > qChr) || ((pending.chr == qChr) && (pending.svStart > lastPos))) break;
+	if ((pending.chr > firstChr) || ((pending.chr == firstChr) && (pending.svStart >= firstPos))) intra.insert(pending, pendingRow);
+	if (!_nextIntra(c, d)) return false;
+      }
+      if (intra.size() > peakWindow) peakWindow = intra.size();
+      return true;
+    }
+
+  private:
+    SVSweep(SVSweep const&);
+    SVSweep& operator=(SVSweep const&);
+  };
+
+
+  // First pass writes the annotation BCF and collects inter-chromosomal SVs, the second pass streams the database
+  template<typename TConfig>
+  inline bool
+  openSweep(TConfig const& c, DatabaseConfig const& d, SVSweep& sweep) {
+    boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Parse SV annotation database (streaming)" << std::endl;
+
+    sweep.nfields = d.dbFields.size();
+    sweep.nDbChr = 0;
+    {
+      DbRecordReader reader;
+      if (!reader.open(c, d)) {
+	reader.close();
+	return false;
+      }
+      for(int32_t rid = 0; rid < reader.hdr->n[BCF_DT_CTG]; ++rid) {
+	int32_t chr = _chrIndex(c.nchr, std::string(bcf_hdr_id2name(reader.hdr, rid)));
+	if (chr >= sweep.nDbChr) sweep.nDbChr = chr + 1;
+      }
+      htsFile* ofile = NULL;
+      bcf_hdr_t* hdr_out = NULL;
+      if ((!d.annofile.empty()) && (!_openAnnoFile(c, d, reader.hdr, ofile, hdr_out))) {
+	reader.close();
+	return false;
+      }
+      SV sv;
+      std::string row;
+      while (reader.next(c, d, sv, row)) {
+	_writeAnnoRecord(ofile, hdr_out, reader.rec, sv.id);
+	if (sv.chr != sv.chr2) sweep.inter.append(sv, row);
+      }
+      sweep.inter.sort();
+      sweep.interIndex.build(sweep.inter.begin(), sweep.inter.end());
+      now = boost::posix_time::second_clock::local_time();
+      std::cerr << '[' << boost::posix_time::to_simple_string(now) << "] Parsed " << reader.svid << " out of " << reader.sitecount << " VCF/BCF records, " << sweep.inter.size() << " inter-chromosomal SVs kept in memory." << std::endl;
+      if (ofile != NULL) {
+	bcf_hdr_destroy(hdr_out);
+	hts_close(ofile);
+      }
+      reader.close();
+      if (!d.annofile.empty()) bcf_index_build(d.annofile.string().c_str(), 14);
+    }
+
+    // Stream intra-chromosomal SVs
+    if (!sweep.reader.open(c, d)) return false;
+    return sweep._nextIntra(c, d);
+  }
+
+}
+
+#endif
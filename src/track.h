@@ -0,0 +1,133 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/icl/interval_set.hpp>
+
+#include "util.h"
+#include "itree.h"
+#include "summary.h"
+#include "bed.h"
+#include "gtf.h"
+#include "gff3.h"
+#include "featuredb.h"
+#include "featurereader.h"
+
+namespace sansa
+{
+
+  // Settings of a single feature annotation track, a -g file with its -i/-f values
+  struct FeatureConfig {
+    typedef std::map<std::string, int32_t> TChrMap;
+    int32_t gtfFileFormat;   // 0 = gtf, 1 = bed, 2 = gff3, 3 = sansa feature index
+    std::string idname;
+    std::string feature;
+    std::vector<bool> queryChr;   // Chromosomes with query SVs, only filled for tabix-indexed feature files
+    TChrMap nchr;
+    boost::filesystem::path gtfFile;
+  };
+
+  // Flattened features of a track with their interval index
+  struct FeatureTrack {
+    typedef std::vector<IntervalLabel> TChromosomeRegions;
+    typedef std::vector<TChromosomeRegions> TGenomicRegions;
+    typedef std::vector<ChromosomeIndex> TGenomicIndex;
+    typedef std::vector<std::string> TGeneIds;
+    FeatureConfig fc;
+    TGenomicRegions gRegions;
+    TGenomicIndex gIndex;
+    TGeneIds geneIds;
+    FeatureSummary fs;
+  };
+
+  inline int32_t
+  _featureFileFormat(boost::filesystem::path const& f) {
+    if (is_featuredb(f)) return 3; // sansa featureindex
+    else if (is_gff3(f)) return 2; // GFF3
+    else if (is_gtf(f)) return 0; // GTF/GFF2
+    return 1;  // BED
+  }
+
+  // Flattened, start-sorted features of a GTF/GFF3/BED file or a prebuilt feature index
+  template<typename TConfig, typename TGenomicRegions, typename TGeneIds>
+  inline bool
+  parseFeatures(TConfig const& c, TGenomicRegions& gRegions, TGeneIds& geneIds, std::vector<bool>& pCoding) {
+    int32_t tf = 0;
+    if (c.gtfFileFormat == 0) tf = parseGTF(c, gRegions, geneIds, pCoding);
+    else if (c.gtfFileFormat == 1) tf = parseBED(c, gRegions, geneIds, pCoding);
+    else if (c.gtfFileFormat == 2) tf = parseGFF3(c, gRegions, geneIds, pCoding);
+    else if (c.gtfFileFormat == 3) return (loadFeatureIndex(c, gRegions, geneIds, pCoding) > 0);
+    if (tf == 0) return false;
+    for(uint32_t refIndex = 0; refIndex < gRegions.size(); ++refIndex) std::sort(gRegions[refIndex].begin(), gRegions[refIndex].end());
+    return true;
+  }
+
+  inline bool
+  loadFeatureTrack(FeatureTrack& tr, int32_t const maxRID, bool const featureSummary) {
+    tr.gRegions.resize(maxRID, FeatureTrack::TChromosomeRegions());
+    if (!parseFeatures(tr.fc, tr.gRegions, tr.geneIds, tr.fs.pCoding)) {
+      std::cerr << "Error parsing GTF/GFF3/BED file " << tr.fc.gtfFile.string() << "!" << std::endl;
+      return false;
+    }
+    buildIntervalIndex(tr.gRegions, tr.gIndex);
+    if (featureSummary) buildFeatureSummary(tr.gRegions, tr.fs);
+    return true;
+  }
+
+  // Tracks of the same GTF/GFF3 file and attribute that only differ in the feature type share a single parsing pass
+  inline void
+  _featureTrackGroups(std::vector<FeatureTrack> const& tracks, std::vector<std::vector<uint32_t> >& groups) {
+    groups.clear();
+    for(uint32_t t = 0; t < tracks.size(); ++t) {
+      FeatureConfig const& fc = tracks[t].fc;
+      bool grouped = false;
+      if ((fc.gtfFileFormat == 0) || (fc.gtfFileFormat == 2)) {
+	for(uint32_t g = 0; g < groups.size(); ++g) {
+	  FeatureConfig const& gc = tracks[groups[g][0]].fc;
+	  if ((gc.gtfFileFormat == fc.gtfFileFormat) && (gc.gtfFile == fc.gtfFile) && (gc.idname == fc.idname)) {
+	    groups[g].push_back(t);
+	    grouped = true;
+	    break;
+	  }
+	}
+      }
+      if (!grouped) groups.push_back(std::vector<uint32_t>(1, t));
+    }
+  }
+
+  // Feature tracks of one group, the GTF/GFF3 file is decompressed and parsed once for all feature types
+  inline bool
+  loadFeatureTracks(std::vector<FeatureTrack>& tracks, std::vector<uint32_t> const& group, int32_t const maxRID, bool const featureSummary) {
+    if (group.size() == 1) return loadFeatureTrack(tracks[group[0]], maxRID, featureSummary);
+    FeatureConfig const& fc = tracks[group[0]].fc;
+    std::vector<std::string> features;
+    for(uint32_t k = 0; k < group.size(); ++k) features.push_back(tracks[group[k]].fc.feature);
+    std::vector<FeatureTrack::TGenomicRegions> gRegions(group.size(), FeatureTrack::TGenomicRegions(maxRID, FeatureTrack::TChromosomeRegions()));
+    std::vector<FeatureTrack::TGeneIds> geneIds(group.size());
+    std::vector<std::vector<bool> > pCoding(group.size());
+    if (fc.gtfFileFormat == 0) parseGTF(fc, features, gRegions, geneIds, pCoding);
+    else parseGFF3(fc, features, gRegions, geneIds, pCoding);
+    for(uint32_t k = 0; k < group.size(); ++k) {
+      if (geneIds[k].empty()) {
+	std::cerr << "Error parsing GTF/GFF3 file " << fc.gtfFile.string() << ", no " << features[k] << " features!" << std::endl;
+	return false;
+      }
+      FeatureTrack& tr = tracks[group[k]];
+      tr.gRegions.swap(gRegions[k]);
+      tr.geneIds.swap(geneIds[k]);
+      tr.fs.pCoding.swap(pCoding[k]);
+      for(uint32_t refIndex = 0; refIndex < tr.gRegions.size(); ++refIndex) std::sort(tr.gRegions[refIndex].begin(), tr.gRegions[refIndex].end());
+      buildIntervalIndex(tr.gRegions, tr.gIndex);
+      if (featureSummary) buildFeatureSummary(tr.gRegions, tr.fs);
+    }
+    return true;
+  }
+
+}
+
+#endif
@@ -9,10 +9,16 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/icl/interval_set.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <htslib/sam.h>
 #include <htslib/faidx.h>
 #include <htslib/vcf.h>
+#include <htslib/bgzf.h>
+#include <htslib/thread_pool.h>
+
+#include <unistd.h>
 
 namespace sansa
 {
@@ -48,6 +54,29 @@ namespace sansa
     // Uniqueness not necessary because we flatten the interval map
     cr.push_back(IntervalLabel(s, e, strand, lid));
   }
+
+  // Make intervals non-overlapping for each label, overlapping intervals are sorted by label in place
+  inline void
+  _mergeLabelIntervals(std::vector<IntervalLabel>& overlapping, std::vector<IntervalLabel>& cr) {
+    // Sort by ID
+    std::sort(overlapping.begin(), overlapping.end(), SortIntervalLabel<IntervalLabel>());
+    int32_t runningId = -1;
+    char runningStrand = '*';
+    typedef boost::icl::interval_set<uint32_t> TIdIntervals;
+    typedef TIdIntervals::interval_type TIVal;
+    TIdIntervals idIntervals;
+    for(uint32_t i = 0; i < overlapping.size(); ++i) {
+      if (overlapping[i].lid != runningId) {
+	for(TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) cr.push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
+	idIntervals.clear();
+	runningId = overlapping[i].lid;
+	runningStrand = overlapping[i].strand;
+      }
+      idIntervals.insert(TIVal::right_open(overlapping[i].start, overlapping[i].end));
+    }
+    // Process last id
+    for(TIdIntervals::iterator it = idIntervals.begin(); it != idIntervals.end(); ++it) cr.push_back(IntervalLabel(it->lower(), it->upper(), runningStrand, runningId));
+  }
   
   // Structural variant record
   struct SV {
@@ -162,43 +191,6 @@ namespace sansa
     return ((value.empty()) || (value == "."));
   }
   
-  inline bool
-  _parse_bcf_string(bcf_hdr_t* hdr, bcf1_t* rec, std::string const& key, std::string& strval) {
-    if (_isKeyPresent(hdr, key)) {
-      char* chr2 = NULL;
-      int32_t nchr2 = 0;
-      if (bcf_get_info_string(hdr, rec, key.c_str(), &chr2, &nchr2) > 0) strval = std::string(chr2);
-      else return false;
-      if (chr2 != NULL) free(chr2);
-    } else return false;
-    return true;
-  }
-
-  inline bool
-  _parseSVTYPE(bcf_hdr_t* hdr, bcf1_t* rec, std::string& svtval) {
-    if (_parse_bcf_string(hdr, rec, "SVTYPE", svtval)) return true;
-    else {
-      std::string altAllele = rec->d.allele[1];
-      if ((altAllele.size() > 2) && (altAllele[0] == '<') && (altAllele[altAllele.size() - 1] == '>')) {
-	svtval = altAllele.substr(1,altAllele.size()-2);
-      } else return false;
-    }
-    return true;
-  }
-
-  inline bool
-  _parse_bcf_int32(bcf_hdr_t* hdr, bcf1_t* rec, std::string const& key, int32_t& intval) {
-    if (_isKeyPresent(hdr, key)) {
-      int32_t nsvlen = 0;
-      int32_t* svlen = NULL;
-      if (bcf_get_info_int32(hdr, rec, key.c_str(), &svlen, &nsvlen) > 0) intval = *svlen;
-      else return false;
-      if (svlen != NULL) free(svlen);
-    } else return false;
-    return true;
-  }
-
-
   inline int32_t
   deriveEndPos(bcf1_t* rec, std::string const& svtval, int32_t const pos2val, int32_t const endval) {
     if ((pos2val != -1) && (endval != -1)) {
@@ -220,63 +212,6 @@ namespace sansa
     return -1;
   }
 
-  inline bool
-  parseAltBnd(bcf_hdr_t* hdr, bcf1_t* rec, std::string& svtval, std::string& ctval, std::string& chr2Name, int32_t& endval) {
-    if (endval != -1) return true;  // Done.
-    if (svtval != "BND") return false;
-    std::string altAllele = rec->d.allele[1];
-    std::size_t found1 = altAllele.find_first_of("[");
-    std::size_t found2 = altAllele.find_last_of("[");
-    if ((found1 == std::string::npos) && (found2 == std::string::npos)) {
-      found1 = altAllele.find_first_of("]");
-      found2 = altAllele.find_last_of("]");
-    }
-    if ((found1 == std::string::npos) || (found2 == std::string::npos)) return false;
-    if (found1 + 1 >= found2) return false;
-    altAllele = altAllele.substr(found1 + 1, found2 - found1 - 1);
-    std::size_t sepa = altAllele.find_first_of(":");
-    if (sepa == std::string::npos) return false;
-    chr2Name = altAllele.substr(0, sepa);
-    endval = boost::lexical_cast<int32_t>(altAllele.substr(sepa+1));
-    std::string chr1Name = bcf_hdr_id2name(hdr, rec->rid);
-    if (chr1Name == chr2Name) {
-      // Fix SV type
-      int32_t pos = rec->pos + 1;
-      if (pos > endval) return false;
-      std::string svclass = "NA";
-      if (_parse_bcf_string(hdr, rec, "SVCLASS", svclass)) {
-	if (svclass == "DEL") {
-	  svtval = "DEL";
-	  ctval = "3to5";
-	} else if (svclass == "DUP") {
-	  svtval = "DUP";
-	  ctval = "5to3";
-	} else if (svclass == "h2hINV") {
-	  svtval = "INV";
-	  ctval = "3to3";
-	} else if (svclass == "t2tINV") {
-	  svtval = "INV";
-	  ctval = "5to5";
-	} else if (svclass == "INS") {
-	  svtval = "INS";
-	  ctval = "NtoN";
-	  endval = rec->pos + 2;
-	}
-      }
-      if (svtval == "BND") {
-	// Still not fixed, try CT
-	if (ctval == "3to5") svtval = "DEL";
-	else if (ctval == "5to3") svtval = "DUP";
-	else if (ctval == "3to3") svtval = "INV";
-	else if (ctval == "5to5") svtval = "INV";
-	else if (ctval == "NtoN") svtval = "INS";
-	else return false;
-      }	
-      //std::cerr << std::string(rec->d.allele[1]) << ',' << chr1Name << ',' << pos << ',' << chr2Name << ',' << endval << ',' << svtval << ',' << ctval << ',' << svclass << std::endl;
-    }
-    return true;
-  }
-
   inline int32_t
   deriveSvLength(bcf1_t* rec, std::string const& svtval, int32_t const endval, int32_t const svlenval) {
     if (svlenval != 0) {
@@ -417,7 +352,7 @@ namespace sansa
     else return false;
   }
 
-  inline std::string
+  inline char const*
   _translateSvType(int32_t const svt) {
     if (svt == 0) return "INV";
     else if (svt == 1) return "INV";
@@ -432,7 +367,7 @@ namespace sansa
     else return "BND";
   }
 
-  inline std::string
+  inline char const*
   _translateCt(int32_t const svt) {
     if (svt == 0) return "3to3";
     else if (svt == 1) return "5to5";
@@ -446,35 +381,70 @@ namespace sansa
     else return "NA";
   }    
   
-  // Decode Orientation
-  inline int32_t
-  _decodeOrientation(std::string const& value, std::string const& svt) {
-    if ((svt == "BND") || (svt == "TRA")) {
-      if (value=="NA") return DELLY_SVT_TRANS + 0;
-      else if (value=="3to3") return DELLY_SVT_TRANS + 0;
-      else if (value=="5to5") return DELLY_SVT_TRANS + 1;
-      else if (value=="3to5") return DELLY_SVT_TRANS + 2;
-      else if (value=="5to3") return DELLY_SVT_TRANS + 3;
-      else return -1;
-    } else {
-      if (value=="NA") {
-	if (svt == "DEL") return 2;
-	else if (svt == "INV") return 0;
-	else if (svt == "DUP") return 3;
-	else if (svt == "INS") return 4;
-	else if (svt == "CNV") return 9;  
-	else if (svt == "CPX") return 10;
-	else if (svt == "CTX") return 11;
-	else if (svt == "SCNA") return 12;
-	else if (svt == "MCNV") return 13;
-	else return -1;
-      }
-      else if (value=="3to3") return 0;
-      else if (value=="5to5") return 1;
-      else if (value=="3to5") return 2;
-      else if (value=="5to3") return 3;
-      else return 4;
+  inline void
+  _parseDbFields(std::string const& str, std::vector<std::string>& fields) {
+    std::vector<std::string> tokens;
+    boost::split(tokens, str, boost::is_any_of(","));
+    for(uint32_t i = 0; i < tokens.size(); ++i) {
+      boost::trim(tokens[i]);
+      if (!tokens[i].empty()) fields.push_back(tokens[i]);
+    }
+  }
+
+  // One htslib thread pool shared by all BGZF readers and writers of a command
+  inline void
+  _initThreadPool(htsThreadPool& tpool, int32_t const threads) {
+    tpool.pool = NULL;
+    tpool.qsize = 0;
+    if (threads > 1) tpool.pool = hts_tpool_init(threads);
+  }
+
+  inline void
+  _attachThreadPool(htsFile* fp, htsThreadPool const& tpool) {
+    if ((fp != NULL) && (tpool.pool != NULL)) hts_set_opt(fp, HTS_OPT_THREAD_POOL, &tpool);
+  }
+
+  inline void
+  _attachThreadPool(BGZF* fp, htsThreadPool const& tpool) {
+    if ((fp != NULL) && (tpool.pool != NULL)) bgzf_thread_pool(fp, tpool.pool, tpool.qsize);
+  }
+
+  inline void
+  _destroyThreadPool(htsThreadPool& tpool) {
+    if (tpool.pool != NULL) hts_tpool_destroy(tpool.pool);
+    tpool.pool = NULL;
+  }
+
+  // Destroys the shared thread pool on every exit path of a command, an explicit _destroyThreadPool releases it earlier
+  struct ThreadPoolGuard {
+    htsThreadPool& tpool;
+
+    ThreadPoolGuard(htsThreadPool& p, int32_t const threads) : tpool(p) {
+      _initThreadPool(tpool, threads);
+    }
+
+    ~ThreadPoolGuard() {
+      _destroyThreadPool(tpool);
     }
+
+  private:
+    ThreadPoolGuard(ThreadPoolGuard const&);
+    ThreadPoolGuard& operator=(ThreadPoolGuard const&);
+  };
+
+  // Wall time of a processing stage
+  inline void
+  _stageTime(std::string const& stage, boost::posix_time::ptime const& start) {
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+    std::cerr << '[' << boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()) << "] " << stage << " took " << (now - start).total_milliseconds() / 1000.0 << "s" << std::endl;
+  }
+
+  template<typename TChrMap>
+  inline int32_t
+  _chrIndex(TChrMap const& chrMap, std::string const& chrName) {
+    typename TChrMap::const_iterator itcm = chrMap.find(chrName);
+    if (itcm == chrMap.end()) return 0;
+    return itcm->second;
   }
 
   template<typename TChrMap>
@@ -567,6 +537,8 @@ namespace sansa
   // Output directory/file checks
   inline bool
   _outfileValid(boost::filesystem::path& outfile) {
+    // Standard output
+    if (outfile.string() == "-") return true;
     try {
       boost::filesystem::path outdir;
       if (outfile.has_parent_path()) outdir = outfile.parent_path();
@@ -574,17 +546,15 @@ namespace sansa
       if (!boost::filesystem::exists(outdir)) {
 	std::cerr << "Output directory does not exist: " << outdir << std::endl;
 	return false;
-      } else {
+      }
+      // Check permissions without creating a probe file, an existing output file is left untouched until it is written
+      bool writable = (access(outdir.string().c_str(), W_OK | X_OK) == 0);
+      if ((writable) && (boost::filesystem::exists(outfile))) writable = ((!boost::filesystem::is_directory(outfile)) && (access(outfile.string().c_str(), W_OK) == 0));
+      if (!writable) {
 	boost::filesystem::file_status s = boost::filesystem::status(outdir);
-	boost::filesystem::ofstream file(outfile.string());
-	file.close();
-	if (!(boost::filesystem::exists(outfile) && boost::filesystem::is_regular_file(outfile))) {
-	  std::cerr << "Fail to open output file " << outfile.string() << std::endl;
-	  std::cerr << "Output directory permissions: " << s.permissions() << std::endl;
-	  return false;
-	} else {
-	  boost::filesystem::remove(outfile.string());
-	}
+	std::cerr << "Fail to open output file " << outfile.string() << std::endl;
+	std::cerr << "Output directory permissions: " << s.permissions() << std::endl;
+	return false;
       }
     } catch (boost::filesystem::filesystem_error const& e) {
       std::cerr << e.what() << std::endl;
@@ -593,6 +563,7 @@ namespace sansa
     return true;
   }
 
+
 }
 
 #endif